@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define ROUNDS 20
+
+double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void report(const char *name, double secs) {
+  double mpix = (double)WIDTH * HEIGHT * ROUNDS / 1e6;
+  printf("  %-24s %8.2f ms/frame %10.2f Mpix/s\n", name, secs * 1000.0 / ROUNDS, mpix / secs);
+}
+
+int main(void) {
+  Canvas cnv = create_canvas(WIDTH, HEIGHT);
+  Canvas back = create_canvas(WIDTH, HEIGHT);
+  srand(69);
+  foreach_pixel(&cnv, it) {
+    it->red = rand();
+    it->green = rand();
+    it->blue = rand();
+    it->alpha = rand();
+  }
+
+  // A full HD frame of planes doesn't fit in the default temp arena
+  Arena arena = create_arena(sizeof(float)*4*cnv.count + 4*PIXELS_ARENA_ALIGNMENT);
+  pixels_set_temp_arena(&arena);
+  Hsla_Planes planes = pixels_temp_hsla_planes(cnv.count);
+  if (planes.hue == NULL) {
+    fprintf(stderr, "[ERROR] Could not allocate HSL planes\n");
+    return 1;
+  }
+
+  printf("Converting %d frames of (%d, %d)\n", ROUNDS, WIDTH, HEIGHT);
+
+  double start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (size_t i = 0; i < cnv.count; ++i) {
+      Hsla hsl = rgb2hsl(cnv.pixels[i]);
+      planes.hue[i] = hsl.hue;
+      planes.saturation[i] = hsl.saturation;
+      planes.lightness[i] = hsl.lightness;
+      planes.alpha[i] = hsl.alpha;
+    }
+  }
+  report("scalar rgb2hsl", now_secs() - start);
+
+  start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (size_t i = 0; i < cnv.count; ++i) {
+      Hsla hsl = { planes.hue[i], planes.saturation[i], planes.lightness[i], planes.alpha[i] };
+      back.pixels[i] = hsl2rgb(hsl);
+    }
+  }
+  report("scalar hsl2rgb", now_secs() - start);
+
+  start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) canvas_rgb2hsl(&cnv, planes);
+  report("canvas_rgb2hsl", now_secs() - start);
+
+  start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) canvas_hsl2rgb(&back, planes);
+  report("canvas_hsl2rgb", now_secs() - start);
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < cnv.count; ++i) {
+    if (memcmp(cnv.pixels + i, back.pixels + i, sizeof(Rgba)) != 0) mismatches += 1;
+  }
+  printf("Round trip mismatches: %zu of %zu pixels\n", mismatches, cnv.count);
+
+  return mismatches == 0 ? 0 : 1;
+}
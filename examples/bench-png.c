@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+#define ROUNDS 5
+
+typedef struct {
+  size_t size;
+} Counter;
+
+double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Only counts the bytes, the benchmark is about the encoders and not the disk
+bool count_bytes(void *user, const void *data, size_t size) {
+  (void)data;
+  ((Counter*)user)->size += size;
+  return true;
+}
+
+void stbi_count_bytes(void *user, void *data, int size) {
+  count_bytes(user, data, size);
+}
+
+void report(const char *name, double secs, size_t size) {
+  double mb = (double)WIDTH * HEIGHT * 4 * ROUNDS / 1e6;
+  printf("  %-28s %8.2f ms/frame %8.1f MB/s %10zu bytes\n", name, secs * 1000.0 / ROUNDS, mb / secs, size / ROUNDS);
+}
+
+int main(void) {
+  Canvas cnv = create_canvas(WIDTH, HEIGHT);
+  Camera camera = default_camera(WIDTH, HEIGHT);
+  float w = WIDTH * 0.5f, h = HEIGHT * 0.5f;
+  Triangle tris[] = {
+    {
+      .a = { .position = { -w, -h, 0 }, .color = { 30, 30, 90, 255 } },
+      .b = { .position = { w, -h, 0 }, .color = { 90, 30, 30, 255 } },
+      .c = { .position = { 0, h, 0 }, .color = { 30, 90, 30, 255 } },
+    },
+    {
+      .a = { .position = { -w*0.8f, h*0.8f, 0 }, .color = { 255, 0, 0, 160 } },
+      .b = { .position = { 0, -h*0.8f, 0 }, .color = { 0, 255, 0, 160 } },
+      .c = { .position = { w*0.8f, h*0.8f, 0 }, .color = { 0, 0, 255, 160 } },
+    },
+  };
+  for (size_t i = 0; i < PIXELS_ARRAY_LEN(tris); ++i) {
+    render_triangle_ex(&cnv, camera, tris[i], .blend = PIXELS_BLEND_SRC_OVER, .linear_light = true);
+  }
+
+  printf("Encoding %d frames of (%d, %d)\n", ROUNDS, WIDTH, HEIGHT);
+
+  Counter counter = {0};
+  double start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) {
+    stbi_write_png_to_func(stbi_count_bytes, &counter, WIDTH, HEIGHT, 4, cnv.pixels, 0);
+  }
+  report("stbi_write_png_to_func", now_secs() - start, counter.size);
+
+  counter.size = 0;
+  start = now_secs();
+  for (int round = 0; round < ROUNDS; ++round) {
+    Png_Writer png;
+    png_init_to_func(&png, count_bytes, &counter, WIDTH, HEIGHT);
+    png_write_canvas(&png, &cnv);
+    png_finish(&png);
+  }
+  report("streaming writer", now_secs() - start, counter.size);
+
+  struct { const char *name; Png_Opt opt; } modes[] = {
+    { "encode_png 1 thread", { .threads = 1 } },
+    { "encode_png all threads", { .threads = 0 } },
+    { "encode_png fast 1 thread", { .threads = 1, .fast = true } },
+    { "encode_png fast all threads", { .threads = 0, .fast = true } },
+  };
+  for (size_t m = 0; m < PIXELS_ARRAY_LEN(modes); ++m) {
+    counter.size = 0;
+    start = now_secs();
+    for (int round = 0; round < ROUNDS; ++round) encode_png_opt(&cnv, count_bytes, &counter, modes[m].opt);
+    report(modes[m].name, now_secs() - start, counter.size);
+  }
+
+  return 0;
+}
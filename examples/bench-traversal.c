@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif // __linux__
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+// 8K UHD
+#define WIDTH 7680
+#define HEIGHT 4320
+#define ROUNDS 2
+
+double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Hardware cache miss counter for this thread, -1 when perf events aren't available (containers, macOS, paranoid kernels)
+int open_cache_misses(void) {
+#ifdef __linux__
+  struct perf_event_attr attr = {0};
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif // __linux__
+}
+
+void start_counting(int fd) {
+#ifdef __linux__
+  if (fd < 0) return;
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#else
+  (void)fd;
+#endif // __linux__
+}
+
+long long stop_counting(int fd) {
+#ifdef __linux__
+  long long count = 0;
+  if (fd < 0) return -1;
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+  return count;
+#else
+  (void)fd;
+  return -1;
+#endif // __linux__
+}
+
+uint64_t hash_canvas(Canvas *cnv) {
+  size_t checkpoint = pixels_temp_save();
+  Rgba *pixels = pixels_temp_alloc(sizeof(Rgba)*cnv->count);
+  canvas_linearize(cnv, pixels);
+  // FNV-1a, just to check every traversal drew the same thing
+  uint64_t h = 14695981039346656037ull;
+  const unsigned char *bytes = (const unsigned char*)pixels;
+  for (size_t i = 0; i < sizeof(Rgba)*(size_t)cnv->width*cnv->height; ++i) h = (h ^ bytes[i]) * 1099511628211ull;
+  pixels_temp_rewind(checkpoint);
+  return h;
+}
+
+int main(void) {
+  const char *layout_names[] = { "linear", "tiled 4x4", "tiled 8x8" };
+  int layout_shifts[] = { PIXELS_LAYOUT_LINEAR, PIXELS_LAYOUT_TILE_4X4, PIXELS_LAYOUT_TILE_8X8 };
+  const char *traversal_names[] = { "rows", "morton", "hilbert" };
+
+  // Exporting an 8K frame for the checksum doesn't fit in the default temp arena
+  Arena arena = create_arena(sizeof(Rgba)*(size_t)WIDTH*HEIGHT + 4*PIXELS_ARENA_ALIGNMENT);
+  pixels_set_temp_arena(&arena);
+
+  int perf_fd = open_cache_misses();
+  if (perf_fd < 0) printf("[WARN] perf events are not available, cache misses won't be reported\n");
+
+  Camera camera = default_camera(WIDTH, HEIGHT);
+  float w = WIDTH * 0.5f, h = HEIGHT * 0.5f;
+  // Two big overlapping triangles, tall enough for every row of the canvas to be a different cache line
+  Triangle tris[] = {
+    {
+      .a = { .position = { -w, h, 0 }, .color = { 255, 0, 0, 200 } },
+      .b = { .position = { 0, -h, 0 }, .color = { 0, 255, 0, 200 } },
+      .c = { .position = { w, h, 0 }, .color = { 0, 0, 255, 200 } },
+    },
+    {
+      .a = { .position = { -w, -h, 0 }, .color = { 255, 255, 0, 120 } },
+      .b = { .position = { w*0.8f, -h*0.2f, 0 }, .color = { 0, 255, 255, 120 } },
+      .c = { .position = { -w*0.2f, h, 0 }, .color = { 255, 0, 255, 120 } },
+    },
+  };
+
+  printf("Rendering %d rounds of %zu triangles on (%d, %d)\n", ROUNDS, PIXELS_ARRAY_LEN(tris), WIDTH, HEIGHT);
+
+  for (size_t l = 0; l < PIXELS_ARRAY_LEN(layout_shifts); ++l) {
+    Canvas cnv = create_canvas_tiled(WIDTH, HEIGHT, layout_shifts[l]);
+    for (int t = PIXELS_TRAVERSAL_ROWS; t <= PIXELS_TRAVERSAL_HILBERT; ++t) {
+      foreach_pixel(&cnv, it) *it = (Rgba) { 0, 0, 0, 255 };
+
+      start_counting(perf_fd);
+      double start = now_secs();
+      for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < PIXELS_ARRAY_LEN(tris); ++i) {
+          render_triangle_ex(&cnv, camera, tris[i], .blend = PIXELS_BLEND_SRC_OVER, .traversal = t);
+        }
+      }
+      double secs = now_secs() - start;
+      long long misses = stop_counting(perf_fd);
+
+      printf("  %-10s %-8s %8.2f ms/round", layout_names[l], traversal_names[t], secs * 1000.0 / ROUNDS);
+      if (misses >= 0) printf(" %12.0f misses/round", (double)misses / ROUNDS);
+      printf("  hash %016llx\n", (unsigned long long)hash_canvas(&cnv));
+    }
+    destroy_canvas(&cnv);
+  }
+
+  return 0;
+}
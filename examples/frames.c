@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define FRAMES 120
+#define OUTPUT_FOLDER "./frames"
+
+Triangle spun_triangle(float angle) {
+  float r = HEIGHT*0.4f;
+  Triangle tri = {0};
+  Vertice *verts[3] = { &tri.a, &tri.b, &tri.c };
+  Rgba colors[3] = { RED, GREEN, BLUE };
+  for (int i = 0; i < 3; ++i) {
+    float t = angle + i*2.0f*PIXELS_PI/3.0f;
+    verts[i]->position = Vec3(cosf(t)*r, sinf(t)*r, 0);
+    verts[i]->color = colors[i];
+  }
+  return tri;
+}
+
+// Renders the next frame while the previous ones are still being compressed on other threads
+int main(void) {
+  mkdir(OUTPUT_FOLDER, 0755);
+  Async_Writer *writer = async_writer_create(WIDTH, HEIGHT, .format = PIXELS_IMAGE_PNG);
+  if (writer == NULL) {
+    fprintf(stderr, "[ERROR] Could not create frame writer\n");
+    return 1;
+  }
+
+  Camera cam = default_camera(WIDTH, HEIGHT);
+  bool ok = true;
+  for (int i = 0; i < FRAMES && ok; ++i) {
+    Canvas cnv;
+    ok = async_writer_acquire(writer, &cnv);
+    if (!ok) break;
+    canvas_fill(&cnv, RGB(0, 0, 0), 1);
+    render_triangle(&cnv, cam, spun_triangle(i*2.0f*PIXELS_PI/FRAMES));
+
+    char path[64];
+    snprintf(path, sizeof(path), OUTPUT_FOLDER"/frame-%03d.png", i);
+    ok = async_writer_submit(writer, &cnv, path);
+  }
+  ok = async_writer_destroy(writer) && ok;
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR] Failed to write frames\n");
+    return 1;
+  }
+  fprintf(stdout, "[INFO] Wrote %d frames to '%s'\n", FRAMES, OUTPUT_FOLDER);
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+// Big enough that the full frame is a few hundred MB we never hold at once
+#define WIDTH 8192
+#define HEIGHT 8192
+#define BAND_HEIGHT 128
+
+void draw_scene(Canvas *cnv, Camera camera, void *user) {
+  (void)user;
+  float w = WIDTH * 0.5f, h = HEIGHT * 0.5f;
+  Triangle back = {
+    .a = { .position = { -w, -h, 0 }, .color = { 30, 30, 90, 255 } },
+    .b = { .position = { w, -h, 0 }, .color = { 90, 30, 30, 255 } },
+    .c = { .position = { 0, h, 0 }, .color = { 30, 90, 30, 255 } },
+  };
+  Triangle front = {
+    .a = { .position = { -w*0.8f, h*0.8f, 0 }, .color = { 255, 0, 0, 160 } },
+    .b = { .position = { 0, -h*0.8f, 0 }, .color = { 0, 255, 0, 160 } },
+    .c = { .position = { w*0.8f, h*0.8f, 0 }, .color = { 0, 0, 255, 160 } },
+  };
+  render_triangle(cnv, camera, back);
+  render_triangle_ex(cnv, camera, front, .blend = PIXELS_BLEND_SRC_OVER, .linear_light = true);
+}
+
+// Every band gets compressed and written while the next one hasn't been rendered yet
+bool write_band(const Canvas *band, int y, void *user) {
+  (void)y;
+  return png_write_canvas(user, band);
+}
+
+int main(void) {
+  const char *output_path = "./poster.png";
+  int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "[ERROR] Could not open '%s'\n", output_path);
+    return 1;
+  }
+
+  printf("Rendering (%d, %d) in bands of %d rows\n", WIDTH, HEIGHT, BAND_HEIGHT);
+
+  Png_Writer png;
+  bool ok = png_init(&png, fd, WIDTH, HEIGHT);
+  ok = ok && render_banded(WIDTH, HEIGHT, default_camera(WIDTH, HEIGHT), draw_scene, write_band, .band_height = BAND_HEIGHT, .sink_user = &png);
+  ok = png_finish(&png) && ok;
+  close(fd);
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR] Failed to generate poster: '%s'\n", output_path);
+    return 1;
+  }
+  fprintf(stdout, "[INFO] Generated poster: '%s'\n", output_path);
+  return 0;
+}
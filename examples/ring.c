@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define SLOTS 3
+#define FRAMES 240
+
+Triangle spun_triangle(float angle) {
+  float r = HEIGHT*0.4f;
+  Triangle tri = {0};
+  Vertice *verts[3] = { &tri.a, &tri.b, &tri.c };
+  Rgba colors[3] = { RED, GREEN, BLUE };
+  for (int i = 0; i < 3; ++i) {
+    float t = angle + i*2.0f*PIXELS_PI/3.0f;
+    verts[i]->position = Vec3(cosf(t)*r, sinf(t)*r, 0);
+    verts[i]->color = colors[i];
+  }
+  return tri;
+}
+
+// Reads the frames in place from the shared slots. It's slow for the first half so the producer fills
+// the ring and sleeps on it, then fast so it's the one sleeping until the next frame shows up.
+int consume(int fd) {
+  Frame_Ring ring;
+  if (!frame_ring_open_fd(&ring, fd)) {
+    fprintf(stderr, "[ERROR] Consumer could not open the ring\n");
+    return 1;
+  }
+  int out_of_order = 0, waits = 0;
+  uint64_t covered = 0;
+  for (int i = 0; i < FRAMES; ++i) {
+    Canvas cnv;
+    // Polling first only to count how often the consumer had to sleep on the futex
+    if (!frame_ring_next(&ring, &cnv, false)) {
+      waits += 1;
+      frame_ring_next(&ring, &cnv, true);
+    }
+    // The producer stamps the frame number in the first pixel
+    Rgba stamp = cnv.pixels[0];
+    if (stamp.red + stamp.green*256 != i) out_of_order += 1;
+    for (size_t p = 1; p < cnv.count; ++p) covered += cnv.pixels[p].red + cnv.pixels[p].green + cnv.pixels[p].blue > 0;
+    if (i < FRAMES/2) usleep(2000);
+    frame_ring_release(&ring);
+  }
+  frame_ring_close(&ring);
+  fprintf(stdout, "[INFO] Consumer read %d frames through %d slots, waited for %d of them, %d out of order, %.0f lit pixels per frame\n",
+          FRAMES, SLOTS, waits, out_of_order, (double)covered/FRAMES);
+  return out_of_order == 0 ? 0 : 1;
+}
+
+// Producer and consumer in two processes sharing an anonymous memfd ring, the child gets the fd through fork
+int main(void) {
+  Frame_Ring ring;
+  if (!frame_ring_create(&ring, NULL, WIDTH, HEIGHT, SLOTS)) {
+    fprintf(stderr, "[ERROR] Could not create the frame ring (Linux only)\n");
+    return 1;
+  }
+
+  pid_t child = fork();
+  if (child < 0) {
+    fprintf(stderr, "[ERROR] Could not fork the consumer\n");
+    frame_ring_close(&ring);
+    return 1;
+  }
+  if (child == 0) {
+    // Drop the producer's mapping, the consumer maps the ring on its own
+    int fd = dup(ring.fd);
+    frame_ring_close(&ring);
+    int status = consume(fd);
+    close(fd);
+    fflush(stdout);
+    _exit(status);
+  }
+
+  Camera cam = default_camera(WIDTH, HEIGHT);
+  int waits = 0;
+  for (int i = 0; i < FRAMES; ++i) {
+    Canvas cnv;
+    if (!frame_ring_acquire(&ring, &cnv, false)) {
+      waits += 1;
+      frame_ring_acquire(&ring, &cnv, true);
+    }
+    canvas_fill(&cnv, RGB(0, 0, 0), 1);
+    render_triangle(&cnv, cam, spun_triangle(i*2.0f*PIXELS_PI/FRAMES));
+    cnv.pixels[0] = RGB(i % 256, i / 256, 0);
+    if (i >= FRAMES/2) usleep(2000);
+    frame_ring_publish(&ring, &cnv);
+  }
+
+  int status = 1;
+  waitpid(child, &status, 0);
+  frame_ring_close(&ring);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "[ERROR] Consumer failed\n");
+    return 1;
+  }
+  fprintf(stdout, "[INFO] Producer wrote %d frames, waited for a free slot %d times\n", FRAMES, waits);
+  return 0;
+}
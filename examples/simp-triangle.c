@@ -9,7 +9,17 @@
 #include "stb_image_write.h"
 
 bool render_frame_to_png(const char *output_path, Canvas *cnv) {
-  if (!stbi_write_png(output_path, cnv->width, cnv->height, 4, cnv->pixels, 0)) {
+  // PNGs are straight alpha and row major, premultiplied or tiled canvases only get converted right here
+  size_t checkpoint = pixels_temp_save();
+  Rgba *pixels = cnv->pixels;
+  if ((cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) || cnv->tile_shift != 0) {
+    pixels = pixels_temp_alloc(sizeof(Rgba)*cnv->count);
+    if (pixels == NULL) return false;
+    canvas_export_straight(cnv, pixels);
+  }
+  bool ok = stbi_write_png(output_path, cnv->width, cnv->height, 4, pixels, 0);
+  pixels_temp_rewind(checkpoint);
+  if (!ok) {
     fprintf(stderr, "[ERROR] Failed to generate png frame: '%s'\n", output_path);
     return false;
   }
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define FPS 30
+#define FRAMES (FPS*4)
+
+Triangle spun_triangle(float angle) {
+  float r = HEIGHT*0.4f;
+  Triangle tri = {0};
+  Vertice *verts[3] = { &tri.a, &tri.b, &tri.c };
+  Rgba colors[3] = { RED, GREEN, BLUE };
+  for (int i = 0; i < 3; ++i) {
+    float t = angle + i*2.0f*PIXELS_PI/3.0f;
+    verts[i]->position = Vec3(cosf(t)*r, sinf(t)*r, 0);
+    verts[i]->color = colors[i];
+  }
+  return tri;
+}
+
+// Usage: ./build/spin - | ffmpeg -i - spin.mp4
+int main(int argc, char **argv) {
+  const char *output_path = "./spin.y4m";
+  bool to_stdout = argc > 1 && strcmp(argv[1], "-") == 0;
+  int fd = to_stdout ? STDOUT_FILENO : open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "[ERROR] Could not open '%s'\n", output_path);
+    return 1;
+  }
+
+  Canvas cnv = create_canvas(WIDTH, HEIGHT);
+  Camera cam = default_camera(cnv.width, cnv.height);
+  Video_Sink sink;
+  bool ok = video_sink_open(&sink, fd, WIDTH, HEIGHT, .format = PIXELS_VIDEO_Y4M, .fps_num = FPS);
+  for (int i = 0; i < FRAMES && ok; ++i) {
+    canvas_fill(&cnv, RGB(0, 0, 0), 1);
+    render_triangle(&cnv, cam, spun_triangle(i*2.0f*PIXELS_PI/FRAMES));
+    ok = video_sink_write(&sink, &cnv);
+  }
+  ok = video_sink_close(&sink) && ok;
+  if (!to_stdout) close(fd);
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR] Failed to write video stream\n");
+    return 1;
+  }
+  fprintf(stderr, "[INFO] Wrote %d frames\n", FRAMES);
+  return 0;
+}
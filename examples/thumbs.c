@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define PIXELS_IMPLEMENTATION
+#define PIXELS_STRIP_PREFIX
+#include "pixels.h"
+
+#define SIZE 96
+#define THUMBS 500
+#define OUTPUT_FOLDER "./thumbs"
+
+Triangle spun_triangle(float angle) {
+  float r = SIZE*0.4f;
+  Triangle tri = {0};
+  Vertice *verts[3] = { &tri.a, &tri.b, &tri.c };
+  Rgba colors[3] = { RED, GREEN, BLUE };
+  for (int i = 0; i < 3; ++i) {
+    float t = angle + i*2.0f*PIXELS_PI/3.0f;
+    verts[i]->position = Vec3(cosf(t)*r, sinf(t)*r, 0);
+    verts[i]->color = colors[i];
+  }
+  return tri;
+}
+
+// Dumps lots of tiny PNGs, first from this thread through a file batch and then from the
+// frame writer's threads with batch_files on, so each of them only pays one submit per batch
+int main(void) {
+  mkdir(OUTPUT_FOLDER, 0755);
+  File_Batch *batch = file_batch_create();
+  if (batch == NULL) {
+    fprintf(stderr, "[ERROR] Could not create file batch\n");
+    return 1;
+  }
+  fprintf(stdout, "[INFO] Writing through %s\n", file_batch_uses_io_uring(batch) ? "io_uring" : "open/write/close");
+
+  Canvas cnv = create_canvas(SIZE, SIZE);
+  Camera cam = default_camera(cnv.width, cnv.height);
+  bool ok = cnv.pixels != NULL;
+  for (int i = 0; i < THUMBS && ok; ++i) {
+    canvas_fill(&cnv, RGB(0, 0, 0), 1);
+    render_triangle(&cnv, cam, spun_triangle(i*2.0f*PIXELS_PI/THUMBS));
+    char path[64];
+    snprintf(path, sizeof(path), OUTPUT_FOLDER"/batch-%03d.png", i);
+    ok = file_batch_write_image(batch, path, &cnv, PIXELS_IMAGE_PNG);
+  }
+  ok = file_batch_destroy(batch) && ok;
+  destroy_canvas(&cnv);
+
+  Async_Writer *writer = async_writer_create(SIZE, SIZE, .format = PIXELS_IMAGE_PNG, .batch_files = true);
+  ok = writer != NULL && ok;
+  for (int i = 0; i < THUMBS && ok; ++i) {
+    ok = async_writer_acquire(writer, &cnv);
+    if (!ok) break;
+    canvas_fill(&cnv, RGB(0, 0, 0), 1);
+    render_triangle(&cnv, cam, spun_triangle(i*2.0f*PIXELS_PI/THUMBS));
+    char path[64];
+    snprintf(path, sizeof(path), OUTPUT_FOLDER"/async-%03d.png", i);
+    ok = async_writer_submit(writer, &cnv, path);
+  }
+  if (writer != NULL) ok = async_writer_destroy(writer) && ok;
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR] Failed to write thumbnails\n");
+    return 1;
+  }
+  fprintf(stdout, "[INFO] Wrote %d thumbnails to '%s'\n", 2*THUMBS, OUTPUT_FOLDER);
+  return 0;
+}
@@ -40,6 +40,54 @@ const char *cube_input_paths[] = {
 };
 const char *cube_output_name = "cube";
 
+const char *bench_hsl_input_paths[] = {
+  EXAMPLES_FOLDER"/bench-hsl.c",
+  PIXELS_HEADER_PATH,
+};
+const char *bench_hsl_output_name = "bench-hsl";
+
+const char *bench_traversal_input_paths[] = {
+  EXAMPLES_FOLDER"/bench-traversal.c",
+  PIXELS_HEADER_PATH,
+};
+const char *bench_traversal_output_name = "bench-traversal";
+
+const char *bench_png_input_paths[] = {
+  EXAMPLES_FOLDER"/bench-png.c",
+  PIXELS_HEADER_PATH,
+};
+const char *bench_png_output_name = "bench-png";
+
+const char *poster_input_paths[] = {
+  EXAMPLES_FOLDER"/poster.c",
+  PIXELS_HEADER_PATH,
+};
+const char *poster_output_name = "poster";
+
+const char *spin_input_paths[] = {
+  EXAMPLES_FOLDER"/spin.c",
+  PIXELS_HEADER_PATH,
+};
+const char *spin_output_name = "spin";
+
+const char *frames_input_paths[] = {
+  EXAMPLES_FOLDER"/frames.c",
+  PIXELS_HEADER_PATH,
+};
+const char *frames_output_name = "frames";
+
+const char *thumbs_input_paths[] = {
+  EXAMPLES_FOLDER"/thumbs.c",
+  PIXELS_HEADER_PATH,
+};
+const char *thumbs_output_name = "thumbs";
+
+const char *ring_input_paths[] = {
+  EXAMPLES_FOLDER"/ring.c",
+  PIXELS_HEADER_PATH,
+};
+const char *ring_output_name = "ring";
+
 typedef struct {
   const char *output_name;
   const char **input_paths;
@@ -51,15 +99,33 @@ typedef struct {
 
 #define cube_config(...) ((Build_Config) { .output_name = cube_output_name, .input_paths = cube_input_paths, .inputs_count = NOB_ARRAY_LEN(cube_input_paths), __VA_ARGS__ })
 
+#define bench_hsl_config(...) ((Build_Config) { .output_name = bench_hsl_output_name, .input_paths = bench_hsl_input_paths, .inputs_count = NOB_ARRAY_LEN(bench_hsl_input_paths), __VA_ARGS__ })
+
+#define bench_traversal_config(...) ((Build_Config) { .output_name = bench_traversal_output_name, .input_paths = bench_traversal_input_paths, .inputs_count = NOB_ARRAY_LEN(bench_traversal_input_paths), __VA_ARGS__ })
+
+#define bench_png_config(...) ((Build_Config) { .output_name = bench_png_output_name, .input_paths = bench_png_input_paths, .inputs_count = NOB_ARRAY_LEN(bench_png_input_paths), __VA_ARGS__ })
+
+#define poster_config(...) ((Build_Config) { .output_name = poster_output_name, .input_paths = poster_input_paths, .inputs_count = NOB_ARRAY_LEN(poster_input_paths), __VA_ARGS__ })
+
+#define spin_config(...) ((Build_Config) { .output_name = spin_output_name, .input_paths = spin_input_paths, .inputs_count = NOB_ARRAY_LEN(spin_input_paths), __VA_ARGS__ })
+
+#define frames_config(...) ((Build_Config) { .output_name = frames_output_name, .input_paths = frames_input_paths, .inputs_count = NOB_ARRAY_LEN(frames_input_paths), __VA_ARGS__ })
+
+#define thumbs_config(...) ((Build_Config) { .output_name = thumbs_output_name, .input_paths = thumbs_input_paths, .inputs_count = NOB_ARRAY_LEN(thumbs_input_paths), __VA_ARGS__ })
+
+#define ring_config(...) ((Build_Config) { .output_name = ring_output_name, .input_paths = ring_input_paths, .inputs_count = NOB_ARRAY_LEN(ring_input_paths), __VA_ARGS__ })
+
 bool build(Cmd *cmd, Build_Config *cfg, const char *output_path) {
   nob_cc(cmd);
   nob_cc_flags(cmd);
+  cmd_append(cmd, "-O2");
   cmd_append(cmd, "-I.");
-  cmd_append(cmd, "-lm");
   nob_cc_output(cmd, output_path);
   for (size_t i = 0; i < cfg->inputs_count; ++i) {
     nob_cc_inputs(cmd, cfg->input_paths[i]);
   }
+  // Libraries have to come after the inputs that use them
+  cmd_append(cmd, "-lm", "-lpthread");
 
   return cmd_rsr(cmd);
 }
@@ -95,13 +161,21 @@ bool check_build(Cmd *cmd, Build_Config *cfg) {
 
 
 void usage(const char *program) {
-  printf("%s [-run|-B] <tri|cube|all>\n", program);
+  printf("%s [-run|-B] <tri|cube|poster|spin|frames|thumbs|ring|bench-hsl|bench-traversal|bench-png|all>\n", program);
   printf("  Flags:\n");
   printf("    -run    ---    Run program after building\n");
   printf("    -B      ---    Force rebuild of program\n");
   printf("  Targets:\n");
   printf("    tri     ---     Build example triangle program\n");
   printf("    cube    ---     Build example cube program\n");
+  printf("    poster  ---     Build banded poster render with streaming PNG output\n");
+  printf("    spin    ---     Build Y4M video stream example\n");
+  printf("    frames  ---     Build PNG frame sequence example with background encoding\n");
+  printf("    thumbs  ---     Build batched thumbnail writing example\n");
+  printf("    ring    ---     Build shared memory frame ring example with a consumer process\n");
+  printf("    bench-hsl ---   Build batch HSL conversion benchmark\n");
+  printf("    bench-traversal --- Build tile traversal order benchmark\n");
+  printf("    bench-png ---   Build PNG encoder benchmark\n");
   printf("    all     ---     Build all example programs\n");
 }
 
@@ -128,7 +202,7 @@ int main(int argc, char **argv) {
     if (target != NULL && arg[0] != '-') {
       nob_log(WARNING, "Only one target can be specified at a time, last one will be picked");
     }
-    if (streq(arg, "all") || streq(arg, "tri") || streq(arg, "cube")) {
+    if (streq(arg, "all") || streq(arg, "tri") || streq(arg, "cube") || streq(arg, "poster") || streq(arg, "spin") || streq(arg, "frames") || streq(arg, "thumbs") || streq(arg, "ring") || streq(arg, "bench-hsl") || streq(arg, "bench-traversal") || streq(arg, "bench-png")) {
       target = arg;
       continue;
     }
@@ -160,6 +234,38 @@ int main(int argc, char **argv) {
     if (!check_build(&cmd, &cube_config(.forced = force_rebuild, .run = should_run))) return 1;
   }
 
+  if (all_targets || streq(target, "poster")) {
+    if (!check_build(&cmd, &poster_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "spin")) {
+    if (!check_build(&cmd, &spin_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "frames")) {
+    if (!check_build(&cmd, &frames_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "thumbs")) {
+    if (!check_build(&cmd, &thumbs_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "ring")) {
+    if (!check_build(&cmd, &ring_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "bench-hsl")) {
+    if (!check_build(&cmd, &bench_hsl_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "bench-traversal")) {
+    if (!check_build(&cmd, &bench_traversal_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
+  if (all_targets || streq(target, "bench-png")) {
+    if (!check_build(&cmd, &bench_png_config(.forced = force_rebuild, .run = should_run))) return 1;
+  }
+
 
   return 0;
 }
@@ -1,21 +1,117 @@
 #ifndef PIXELS_H_
 #define PIXELS_H_
 
+// The Linux paths use things strict -std=c99 headers hide (MAP_ANONYMOUS, ftruncate, ...). This only sticks when
+// the implementation is included before any other system header, otherwise those paths get turned off below.
+#if defined(PIXELS_IMPLEMENTATION) && defined(__linux__) && !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
 #include <float.h>
 
+// SIMD paths are picked at compile time, define PIXELS_NO_SIMD to force the scalar ones
+#if !defined(PIXELS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PIXELS_SSE2
+#endif
+#if defined(PIXELS_SSE2) && defined(__SSSE3__)
+#define PIXELS_SSSE3
+#endif
+#if defined(PIXELS_SSE2) && defined(__F16C__)
+#define PIXELS_F16C
+#endif
+
+// File descriptor based output needs unistd
+#if defined(__unix__) || defined(__APPLE__)
+#define PIXELS_POSIX
+#endif
+
+// Worker threads are pthreads, define PIXELS_NO_THREADS to keep everything on the calling thread
+#if !defined(PIXELS_NO_THREADS) && (defined(__linux__) || defined(__APPLE__))
+#define PIXELS_PTHREADS
+#endif
+// Large canvases can come straight from mmap on Linux, define PIXELS_NO_MMAP to always go through PIXELS_MALLOC
+#if !defined(PIXELS_NO_MMAP) && defined(__linux__)
+#define PIXELS_LINUX_MMAP
+#endif
+// Batched file output goes through io_uring when the kernel headers have it, define PIXELS_NO_IO_URING to write synchronously
+#if !defined(PIXELS_NO_IO_URING) && defined(PIXELS_LINUX_MMAP) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PIXELS_IO_URING
+#endif
+#endif
+
 #define PIXELS_PI 3.141592653589793
 #define PIXELS_TAU (2*PI)
 
 #define PIXELS_CLAMP(v, min, max) ((v) < (min) ? (min) : ((v) > (max) ? (max) : (v)))
 #define PIXELS_MIN(a, b) ((a) < (b) ? (a) : (b))
 #define PIXELS_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define PIXELS_ARRAY_LEN(array) (sizeof(array)/sizeof((array)[0]))
 
 #ifndef PIXELS_MALLOC
 #define PIXELS_MALLOC(x) malloc(x)
 #endif
+#ifndef PIXELS_FREE
+#define PIXELS_FREE(x) free(x)
+#endif
+
+#if defined(_MSC_VER)
+#define PIXELS_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define PIXELS_THREAD_LOCAL __thread
+#else
+#define PIXELS_THREAD_LOCAL _Thread_local
+#endif
+
+// Every pointer handed out by an arena is aligned to this, enough for any SIMD load we do
+#ifndef PIXELS_ARENA_ALIGNMENT
+#define PIXELS_ARENA_ALIGNMENT 32
+#endif
+
+// Size of the temp arena each thread lazily allocates if it didn't install one of its own
+#ifndef PIXELS_TEMP_CAPACITY
+#define PIXELS_TEMP_CAPACITY (8*1024*1024)
+#endif
+
+// Bump allocator for transient memory, there's no per allocation free; everything goes away at once with a reset or rewind
+typedef struct {
+  unsigned char *data;
+  size_t size, capacity;
+  int owns_data;
+} Pixels_Arena;
+
+// Creates an arena whose backing memory comes from PIXELS_MALLOC
+Pixels_Arena pixels_create_arena(size_t capacity);
+// Creates an arena on top of a caller owned buffer, the arena never frees it
+Pixels_Arena pixels_arena_from_buffer(void *buffer, size_t capacity);
+// Frees the backing memory if the arena owns it
+void pixels_destroy_arena(Pixels_Arena *arena);
+// Returns NULL if the arena doesn't have enough space left
+void *pixels_arena_alloc(Pixels_Arena *arena, size_t size);
+void pixels_arena_reset(Pixels_Arena *arena);
+// Checkpoints work like nob_temp_save()/nob_temp_rewind(), rewinding frees everything allocated after the save
+size_t pixels_arena_save(Pixels_Arena *arena);
+void pixels_arena_rewind(Pixels_Arena *arena, size_t checkpoint);
+
+// Any per-frame scratch memory pixels needs internally comes from the calling thread's temp arena.
+// By default that's a lazily allocated arena of PIXELS_TEMP_CAPACITY bytes, but render threads can install
+// their own (e.g. on top of a stack buffer) to bound memory and keep malloc out of the hot path.
+// The default arena is freed when its thread exits. Without pthreads (PIXELS_NO_THREADS) nothing hooks thread exit,
+// so short lived threads should install their own arena or call pixels_release_temp_arena before returning.
+Pixels_Arena *pixels_temp_arena(void);
+// Installs the temp arena for the calling thread, passing NULL goes back to the default one
+void pixels_set_temp_arena(Pixels_Arena *arena);
+void *pixels_temp_alloc(size_t size);
+size_t pixels_temp_save(void);
+void pixels_temp_rewind(size_t checkpoint);
+void pixels_temp_reset(void);
+// Frees the calling thread's default temp arena, the next temp allocation makes a new one
+void pixels_release_temp_arena(void);
 
 typedef struct {
   unsigned char red, green, blue, alpha;
@@ -41,9 +137,21 @@ typedef struct {
 #define Pixels_HSLa_Fmt "HSL(%.2f, %.2f, %.2f, %.2f)"
 #define Pixels_HSLa_Arg(clr) (clr).hue, (clr).saturation, (clr).lightness, (clr).alpha
 
+// Hue, saturation, lightness and alpha are all in the 0-1 range
 Pixels_Hsla pixels_rgb2hsl(Pixels_Rgba rgb);
 Pixels_Rgba pixels_hsl2rgb(Pixels_Hsla hsl);
 
+// Structure of arrays version of Pixels_Hsla for converting in bulk, each plane holds one float per pixel
+typedef struct {
+  float *hue, *saturation, *lightness, *alpha;
+} Pixels_Hsla_Planes;
+
+// Allocates planes for count pixels out of the temp arena, all of them are NULL if it ran out of space
+Pixels_Hsla_Planes pixels_temp_hsla_planes(size_t count);
+// Batch versions of pixels_rgb2hsl/pixels_hsl2rgb, branchless and 4 pixels at a time when SIMD is available
+void pixels_rgb2hsl_span(const Pixels_Rgba *src, size_t count, Pixels_Hsla_Planes out);
+void pixels_hsl2rgb_span(Pixels_Hsla_Planes in, size_t count, Pixels_Rgba *dst);
+
 typedef struct {
   float x, y;
 } Pixels_Vector2f;
@@ -89,15 +197,138 @@ Pixels_Camera pixels_default_camera(size_t width, size_t height);
 Pixels_Vector2f pixels_calculate_perspective_projection(Pixels_Camera camera, Pixels_Vector3 point);
 
 
+// Canvas flags
+// Pixels are stored with their color premultiplied by alpha, blending onto it never has to divide
+#define PIXELS_CANVAS_PREMULTIPLIED (1u << 0)
+
+// Memory layouts, tiled canvases store square blocks of pixels contiguously so tall triangles
+// don't touch a new cache line on every row
+#define PIXELS_LAYOUT_LINEAR 0
+#define PIXELS_LAYOUT_TILE_4X4 2
+#define PIXELS_LAYOUT_TILE_8X8 3
+
+// Where the pixels of a canvas came from, so pixels_destroy_canvas knows how to give them back
+typedef enum {
+  PIXELS_ALLOC_MALLOC = 0,
+  PIXELS_ALLOC_MMAP,
+  // Shared mapping of a file made by pixels_create_canvas_mapped or pixels_open_canvas_mapped
+  PIXELS_ALLOC_FILE,
+  // Pixels belong to something else (a frame ring slot), destroying the canvas leaves them alone
+  PIXELS_ALLOC_BORROWED,
+} Pixels_Canvas_Alloc;
+
 typedef struct {
   int width, height;
+  // Pixels actually stored, tiled canvases pad the size up to whole tiles
   size_t count;
   Pixels_Rgba *pixels;
+  unsigned int flags;
+  // log2 of the tile size, one of the PIXELS_LAYOUT_* values
+  int tile_shift;
+  Pixels_Canvas_Alloc alloc;
+  // Bytes mapped when alloc isn't PIXELS_ALLOC_MALLOC
+  size_t alloc_size;
+  // Image row that the first row of the canvas stands for. Only triangle rendering looks at it, the bands of
+  // pixels_render_banded set it so triangles get projected and clipped as if the whole image was there.
+  int origin_y;
 } Pixels_Canvas;
 
+// Size of the pages asked for when a canvas wants huge pages
+#ifndef PIXELS_HUGE_PAGE_SIZE
+#define PIXELS_HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+// Canvases smaller than this get their pages touched by the calling thread alone
+#ifndef PIXELS_PARALLEL_TOUCH_MIN
+#define PIXELS_PARALLEL_TOUCH_MIN (64*1024*1024)
+#endif
+
+typedef struct {
+  int tile_shift;
+  // Back the pixels with huge pages (Linux only), falls back to transparent huge pages and then to PIXELS_MALLOC
+  bool huge_pages;
+  // Threads that first touch the pixels, 0 picks one per CPU once the canvas passes PIXELS_PARALLEL_TOUCH_MIN.
+  // Each thread clears a contiguous band of rows, so pages land on the NUMA node of the thread that touched them.
+  int prefault_threads;
+} Pixels_Canvas_Opt;
+
 Pixels_Canvas pixels_create_canvas(int width, int height);
+Pixels_Canvas pixels_create_canvas_tiled(int width, int height, int tile_shift);
+Pixels_Canvas pixels_create_canvas_opt(int width, int height, Pixels_Canvas_Opt opt);
+// Big posters: pixels_create_canvas_ex(100000, 100000, .huge_pages = true)
+#define pixels_create_canvas_ex(width, height, ...) pixels_create_canvas_opt((width), (height), (Pixels_Canvas_Opt) { __VA_ARGS__ })
+void pixels_destroy_canvas(Pixels_Canvas *cnv);
+// Sets every stored pixel to color, split in bands of rows across threads (0 picks the same as canvas creation)
+void pixels_canvas_fill(Pixels_Canvas *cnv, Pixels_Rgba color, int threads);
+
+// Raw canvas file: this header padded to PIXELS_MAPPED_HEADER_SIZE followed by the stored pixels as they are in memory.
+// Padding keeps the pixels page aligned so anything can mmap them straight out of the file.
+#define PIXELS_MAPPED_MAGIC "PIXELSCV"
+#define PIXELS_MAPPED_HEADER_SIZE 4096
+typedef struct {
+  char magic[8];
+  uint32_t header_size;
+  int32_t width, height;
+  int32_t tile_shift;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t count;
+} Pixels_Mapped_Header;
+
+// Canvas whose pixels live in a file mapped into memory (Linux only), the kernel pages tiles in and out as they're drawn,
+// so it can be bigger than RAM. The file gets created or truncated and starts out as transparent black, since
+// clearing it would mean writing the whole thing. Failure gives back a canvas with NULL pixels.
+Pixels_Canvas pixels_create_canvas_mapped(const char *path, int width, int height);
+// Maps a canvas file read only without copying it, meant for other processes once the writer flushed
+Pixels_Canvas pixels_open_canvas_mapped(const char *path);
+// Writes the header and pushes the dirty pages of a file backed canvas out, does nothing for other canvases
+bool pixels_canvas_flush(Pixels_Canvas *cnv);
+
+// Ring of canvases in shared memory for handing frames to another process without copying them (Linux only).
+// The mapping is a PIXELS_FRAME_RING_HEADER_SIZE header followed by the slots, each one page aligned.
+// One producer renders straight into a slot and publishes it, one consumer reads it in place and releases it.
+// Both sides only touch two counters in the header, the only syscall is a futex wake when the other side went to sleep.
+#define PIXELS_FRAME_RING_MAGIC "PIXELSRG"
+#define PIXELS_FRAME_RING_HEADER_SIZE 4096
+#define PIXELS_FRAME_RING_MAX_SLOTS 64
+
+// Lives at the start of the mapping, only defined by the implementation
+struct Pixels_Frame_Ring_Header;
 
-#define pixels_get_pixel(cnv, x, y) ((cnv)->pixels + ((x)+(y)*(cnv)->width))
+typedef struct {
+  // memfd or shm object, hand it to the consumer with SCM_RIGHTS or let it open the shm name
+  int fd;
+  struct Pixels_Frame_Ring_Header *header;
+  size_t map_size;
+  // Next frame this side acquires or reads
+  uint32_t position;
+  // Set between acquire and publish or between next and release
+  bool holding;
+} Pixels_Frame_Ring;
+
+// Producer side. name is a POSIX shm name like "/my-frames", NULL makes an anonymous memfd.
+// Removing a named ring with shm_unlink is up to the caller once the consumer has it open.
+bool pixels_frame_ring_create(Pixels_Frame_Ring *ring, const char *name, int width, int height, int slots);
+// Consumer side, by shm name or by an fd received from the producer (the fd stays owned by the caller)
+bool pixels_frame_ring_open(Pixels_Frame_Ring *ring, const char *name);
+bool pixels_frame_ring_open_fd(Pixels_Frame_Ring *ring, int fd);
+void pixels_frame_ring_close(Pixels_Frame_Ring *ring);
+// Gives the next free slot to render into, false if every slot is still with the consumer and wait is off.
+// The canvas keeps whatever the slot had the last time around, clear it if the frame doesn't cover everything.
+bool pixels_frame_ring_acquire(Pixels_Frame_Ring *ring, Pixels_Canvas *cnv, bool wait);
+// Makes the acquired slot visible to the consumer along with the canvas flags
+void pixels_frame_ring_publish(Pixels_Frame_Ring *ring, const Pixels_Canvas *cnv);
+// Gives the oldest published frame, false if there's none yet and wait is off
+bool pixels_frame_ring_next(Pixels_Frame_Ring *ring, Pixels_Canvas *cnv, bool wait);
+// Hands the slot from pixels_frame_ring_next back to the producer
+void pixels_frame_ring_release(Pixels_Frame_Ring *ring);
+
+// Offset of a pixel in a tiled canvas, with a tile_shift of 0 it's the usual x + y*width
+#define pixels_tiles_x(cnv) (((size_t)(cnv)->width + ((size_t)1 << (cnv)->tile_shift) - 1) >> (cnv)->tile_shift)
+#define pixels_tiled_offset(cnv, x, y) \
+  ((((((size_t)(y) >> (cnv)->tile_shift) * pixels_tiles_x(cnv) + ((size_t)(x) >> (cnv)->tile_shift)) << (2*(cnv)->tile_shift))) + \
+   ((((size_t)(y) & (((size_t)1 << (cnv)->tile_shift) - 1)) << (cnv)->tile_shift) | ((size_t)(x) & (((size_t)1 << (cnv)->tile_shift) - 1))))
+#define pixels_pixel_offset(cnv, x, y) ((cnv)->tile_shift == 0 ? (size_t)(x) + (size_t)(y)*(cnv)->width : pixels_tiled_offset(cnv, x, y))
+#define pixels_get_pixel(cnv, x, y) ((cnv)->pixels + pixels_pixel_offset(cnv, x, y))
 #define pixels_set_pixel(cnv, x, y, clr) \
   do { \
     Pixels_Rgba *p = pixels_get_pixel(cnv, x, y); \
@@ -108,6 +339,16 @@ Pixels_Canvas pixels_create_canvas(int width, int height);
   } while (0)
 #define pixels_foreach_pixel(cnv, it) for (Pixels_Rgba *it = (cnv)->pixels; it <= ((cnv)->pixels + ((cnv)->count-1)); ++it)
 
+// Copies the canvas out in plain row major order, out holds width*height pixels
+void pixels_canvas_linearize(const Pixels_Canvas *cnv, Pixels_Rgba *out);
+
+// 64 bit hash in the style of XXH3's long input loop: eight lanes of 32x32 bit multiplies folded into
+// 64 bit accumulators, 16 bytes at a time with SSE2, so it keeps up with memory. Not XXH3 compatible,
+// and the result depends on endianness, it's for comparing frames in the same process.
+uint64_t pixels_hash(const void *data, size_t size, uint64_t seed);
+// Hash of the stored pixels, the size, layout and flags are mixed in so only canvases that are the same hash the same
+uint64_t pixels_canvas_hash(const Pixels_Canvas *cnv);
+
 
 // Calculate the cross product of a Vec2
 #define pixels_cross_2d(a, b) (a.x * b.y + a.y * b.x)
@@ -134,8 +375,489 @@ float pixels_square_eucledian_dist_vec2f(Pixels_Vector2f a, Pixels_Vector2f b);
 #define pixels_full_eucledian_dist_vec2f(a, b) sqrtf(square_eucledian_dist_vec2f(a, b))
 
 
+// Integer approximation of x/255 rounded to nearest, exact for any x in [0, 255*255]
+#define PIXELS_DIV255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+typedef enum {
+  // Overwrite the destination, this is the default
+  PIXELS_BLEND_REPLACE = 0,
+  // Straight alpha source-over. Opaque destinations (what a fresh canvas is) take the fast path,
+  // translucent ones get the color divided by the resulting alpha so the result stays straight.
+  PIXELS_BLEND_SRC_OVER,
+  // Source-over for colors that are already premultiplied by their alpha
+  PIXELS_BLEND_SRC_OVER_PREMUL,
+  // Adds the source weighted by its alpha, saturating at 255
+  PIXELS_BLEND_ADD,
+  // Multiplies the destination by the source, weighted by the source alpha
+  PIXELS_BLEND_MULTIPLY,
+  // Additive and multiply for sources that are already premultiplied
+  PIXELS_BLEND_ADD_PREMUL,
+  PIXELS_BLEND_MULTIPLY_PREMUL,
+} Pixels_Blend_Mode;
+
+// Blends count source pixels onto the destination, 8 pixels at a time when SIMD is available
+void pixels_blend_span(Pixels_Rgba *dst, const Pixels_Rgba *src, size_t count, Pixels_Blend_Mode mode);
+
+// Multiplies the colors by their alpha in place
+void pixels_premultiply_span(Pixels_Rgba *pixels, size_t count);
+// Reverts pixels_premultiply_span, dst and src may be the same buffer
+void pixels_unpremultiply_span(Pixels_Rgba *dst, const Pixels_Rgba *src, size_t count);
+
+// Converts the canvas contents and sets/clears PIXELS_CANVAS_PREMULTIPLIED
+void pixels_canvas_premultiply(Pixels_Canvas *cnv);
+void pixels_canvas_unpremultiply(Pixels_Canvas *cnv);
+// Copies the canvas out as straight alpha and row major, which is what image writers expect.
+// Premultiplied and tiled canvases should only be converted here, right before exporting.
+void pixels_canvas_export_straight(const Pixels_Canvas *cnv, Pixels_Rgba *out);
+
+// Converts the whole canvas from/into planes that hold cnv->count pixels
+void pixels_canvas_rgb2hsl(const Pixels_Canvas *cnv, Pixels_Hsla_Planes out);
+void pixels_canvas_hsl2rgb(Pixels_Canvas *cnv, Pixels_Hsla_Planes in);
+
+// Nodes per axis of the HSL adjustment lookup table, 33 puts a node every ~8 values of each channel
+#define PIXELS_HSL_LUT_SIZE 33
+#define PIXELS_HSL_LUT_COUNT (PIXELS_HSL_LUT_SIZE*PIXELS_HSL_LUT_SIZE*PIXELS_HSL_LUT_SIZE)
+
+// 3D lookup table of a hue/saturation/lightness adjustment, indexed as [blue][green][red]
+typedef struct {
+  float dh, ds, dl;
+  Pixels_Rgba *entries;
+} Pixels_Hsl_Lut;
+
+// Builds the table for shifting hue by dh turns and adding ds/dl to saturation/lightness.
+// entries must hold PIXELS_HSL_LUT_COUNT colors, scratch memory comes from the temp arena.
+bool pixels_build_hsl_lut(Pixels_Hsl_Lut *lut, Pixels_Rgba *entries, float dh, float ds, float dl);
+// Maps every pixel through the table with trilinear interpolation, alpha is left untouched.
+// Premultiplied canvases are unpremultiplied around the lookup.
+void pixels_canvas_apply_hsl_lut(Pixels_Canvas *cnv, const Pixels_Hsl_Lut *lut);
+// Same as building and applying a table, the last table built on each thread is reused while parameters don't change.
+// That table (~140KB) is heap memory owned by the thread and freed when it exits, same as the default temp arena.
+bool pixels_canvas_adjust_hsl(Pixels_Canvas *cnv, float dh, float ds, float dl);
+// Frees the calling thread's cached table right away, the next adjustment builds a new one
+void pixels_release_hsl_lut_cache(void);
+
+// Order in which the rasterizer walks the tiles of a triangle's bounding box.
+// Curves keep consecutive tiles close in memory, which matters once a row of the canvas stops fitting in cache.
+typedef enum {
+  PIXELS_TRAVERSAL_ROWS = 0,
+  PIXELS_TRAVERSAL_MORTON,
+  PIXELS_TRAVERSAL_HILBERT,
+} Pixels_Traversal;
+
+// Tile size used when walking a linear canvas along a curve, tiled canvases use their own tiles
+#ifndef PIXELS_TRAVERSAL_TILE
+#define PIXELS_TRAVERSAL_TILE 32
+#endif // PIXELS_TRAVERSAL_TILE
+
+// Fills out with the tiles_x*tiles_y tile indices (tx + ty*tiles_x) in traversal order, handy to hand tiles to workers
+void pixels_tile_order(Pixels_Traversal traversal, int tiles_x, int tiles_y, uint32_t *out);
+
+// Per draw options, zero initialized means the same as a plain pixels_render_triangle
+typedef struct {
+  Pixels_Blend_Mode blend;
+  // Interpolate vertex colors in linear light and encode back to sRGB, gradients come out without the muddy middle
+  bool linear_light;
+  Pixels_Traversal traversal;
+} Pixels_Render_Opt;
+
+// Entries of the table used to encode linear light back to sRGB
+#define PIXELS_LINEAR_LUT_SIZE 4096
+
+// sRGB transfer function through lookup tables, linear values are in the 0-1 range
+float pixels_srgb_to_linear(unsigned char c);
+unsigned char pixels_linear_to_srgb(float v);
+
 // Renders a filled in triangle onto the canvas after calculating the projected position with the camera
 void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Triangle tri);
+void pixels_render_triangle_opt(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt);
+// Only set the options you care about: pixels_render_triangle_ex(&cnv, camera, tri, .blend = PIXELS_BLEND_SRC_OVER)
+#define pixels_render_triangle_ex(cnv, camera, tri, ...) pixels_render_triangle_opt((cnv), (camera), (tri), (Pixels_Render_Opt) { __VA_ARGS__ })
+
+// Draws the whole scene onto cnv with the camera it's given, gets called once per band
+typedef void (*Pixels_Scene_Fn)(Pixels_Canvas *cnv, Pixels_Camera camera, void *user);
+// Takes a finished band holding rows [y, y + band->height) of the image, returning false stops the render
+typedef bool (*Pixels_Band_Sink_Fn)(const Pixels_Canvas *band, int y, void *user);
+
+#ifndef PIXELS_BAND_HEIGHT
+#define PIXELS_BAND_HEIGHT 256
+#endif
+
+typedef struct {
+  // Rows per band, 0 means PIXELS_BAND_HEIGHT
+  int band_height;
+  // Canvas flags of the band, like PIXELS_CANVAS_PREMULTIPLIED
+  unsigned int flags;
+  void *scene_user;
+  void *sink_user;
+} Pixels_Banded_Opt;
+
+// Renders a width x height image one horizontal strip at a time so only width*band_height pixels are ever alive.
+// Each band is a fresh opaque black canvas with origin_y at its first row, triangles are rasterized in image
+// coordinates and clipped to the band so the result matches a full frame render bit for bit.
+// Returns false if the band couldn't be allocated or the sink gave up.
+bool pixels_render_banded_opt(int width, int height, Pixels_Camera camera, Pixels_Scene_Fn scene, Pixels_Band_Sink_Fn sink, Pixels_Banded_Opt opt);
+#define pixels_render_banded(width, height, camera, scene, sink, ...) pixels_render_banded_opt((width), (height), (camera), (scene), (sink), (Pixels_Banded_Opt) { __VA_ARGS__ })
+
+typedef struct {
+  float red, green, blue, alpha;
+} Pixels_Rgbaf;
+
+// Same as Pixels_Rgbaf but every channel is an IEEE half float
+typedef struct {
+  uint16_t red, green, blue, alpha;
+} Pixels_Rgbah;
+
+uint16_t pixels_float_to_half(float f);
+float pixels_half_to_float(uint16_t h);
+
+// HDR canvas holding linear light, nothing saturates until it gets tone mapped down to a Pixels_Canvas.
+// Only one of pixels/half_pixels is set, half storage uses half the memory and bandwidth.
+typedef struct {
+  int width, height;
+  size_t count;
+  Pixels_Rgbaf *pixels;
+  Pixels_Rgbah *half_pixels;
+} Pixels_CanvasF;
+
+// Both start out as opaque black
+Pixels_CanvasF pixels_create_canvasf(int width, int height);
+Pixels_CanvasF pixels_create_canvasf_half(int width, int height);
+void pixels_destroy_canvasf(Pixels_CanvasF *cnv);
+
+// Renders onto a float canvas, vertex colors are converted to linear light so linear_light is implied.
+// Premultiplied blend modes expect the vertex colors to be premultiplied.
+void pixels_render_trianglef(Pixels_CanvasF *cnv, Pixels_Camera camera, Pixels_Triangle tri);
+void pixels_render_trianglef_opt(Pixels_CanvasF *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt);
+#define pixels_render_trianglef_ex(cnv, camera, tri, ...) pixels_render_trianglef_opt((cnv), (camera), (tri), (Pixels_Render_Opt) { __VA_ARGS__ })
+
+typedef enum {
+  // Just clamps to 0-1
+  PIXELS_TONEMAP_CLAMP = 0,
+  // c / (1 + c)
+  PIXELS_TONEMAP_REINHARD,
+  // Narkowicz's fit of the ACES filmic curve
+  PIXELS_TONEMAP_ACES,
+} Pixels_Tonemap_Operator;
+
+typedef struct {
+  Pixels_Tonemap_Operator op;
+  // Linear multiplier applied before the operator, 0 is treated as 1
+  float exposure;
+  // Ordered 4x4 Bayer dithering before quantizing, keeps smooth gradients from banding
+  bool dither;
+} Pixels_Tonemap_Opt;
+
+// Tone maps, encodes to sRGB and quantizes src onto dst; both need the same size
+bool pixels_canvasf_tonemap_opt(const Pixels_CanvasF *src, Pixels_Canvas *dst, Pixels_Tonemap_Opt opt);
+#define pixels_canvasf_tonemap(src, dst, ...) pixels_canvasf_tonemap_opt((src), (dst), (Pixels_Tonemap_Opt) { __VA_ARGS__ })
+
+// Extra storage formats, Pixels_Canvas is the RGBA8 one. Each format gets its own canvas type and a rasterizer
+// generated from the same template, so the conversion is inlined into the inner loop instead of switched on per pixel:
+//   Pixels_Canvas_Gray8 pixels_create_canvas_gray8(int width, int height);
+//   void pixels_destroy_canvas_gray8(Pixels_Canvas_Gray8 *cnv);
+//   void pixels_render_triangle_gray8(Pixels_Canvas_Gray8 *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt);
+//   void pixels_canvas_gray8_to_rgba(const Pixels_Canvas_Gray8 *cnv, Pixels_Rgba *out);
+// Formats without alpha read back as opaque when blending.
+typedef struct {
+  unsigned char blue, green, red, alpha;
+} Pixels_Bgra8;
+
+// X(Type_Name, function_name, pixel type)
+#define PIXELS_FORMATS(X) \
+  X(Bgra8,   bgra8,   Pixels_Bgra8) \
+  X(Rgb565,  rgb565,  uint16_t) \
+  X(Gray8,   gray8,   unsigned char) \
+  X(Rgba16f, rgba16f, Pixels_Rgbah)
+
+#define PIXELS__DECLARE_FORMAT(Name, name, Pixel) \
+  typedef struct { \
+    int width, height; \
+    size_t count; \
+    Pixel *pixels; \
+  } Pixels_Canvas_##Name; \
+  Pixels_Canvas_##Name pixels_create_canvas_##name(int width, int height); \
+  void pixels_destroy_canvas_##name(Pixels_Canvas_##Name *cnv); \
+  void pixels_render_triangle_##name(Pixels_Canvas_##Name *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt); \
+  void pixels_canvas_##name##_to_rgba(const Pixels_Canvas_##Name *cnv, Pixels_Rgba *out);
+PIXELS_FORMATS(PIXELS__DECLARE_FORMAT)
+
+// Palette indexed canvas, one byte per pixel for flat shaded renders that only use a handful of colors
+#define PIXELS_PALETTE_CAPACITY 256
+
+typedef struct {
+  int width, height;
+  size_t count;
+  unsigned char *indices;
+  Pixels_Rgba palette[PIXELS_PALETTE_CAPACITY];
+  size_t palette_count;
+} Pixels_Canvas_Indexed;
+
+// Starts out filled with index 0, which is opaque black
+Pixels_Canvas_Indexed pixels_create_canvas_indexed(int width, int height);
+void pixels_destroy_canvas_indexed(Pixels_Canvas_Indexed *cnv);
+// Index of color in the palette, adding it if it's not there yet. Returns -1 when the palette is full.
+int pixels_palette_index(Pixels_Canvas_Indexed *cnv, Pixels_Rgba color);
+// Fills the triangle with a palette index, covered spans are written with memset. Indices past palette_count draw nothing.
+void pixels_render_triangle_index(Pixels_Canvas_Indexed *cnv, Pixels_Camera camera, Pixels_Triangle tri, unsigned char index);
+// Flat shaded render with the color of the first vertex, false if it didn't fit in the palette
+bool pixels_render_triangle_indexed(Pixels_Canvas_Indexed *cnv, Pixels_Camera camera, Pixels_Triangle tri);
+// Expands the indices through the palette, with SSSE3 and up to 16 colors this is a byte shuffle per channel.
+// Indices past palette_count (written straight into indices) come out as transparent black.
+void pixels_canvas_indexed_to_rgba(const Pixels_Canvas_Indexed *cnv, Pixels_Rgba *out);
+
+// Packed 1 bit coverage mask for hit testing and stencils, pixel x of a row is bit x%64 of word x/64
+typedef struct {
+  int width, height;
+  size_t words_per_row;
+  uint64_t *bits;
+} Pixels_Mask;
+
+typedef enum {
+  // Union, covered pixels get set
+  PIXELS_MASK_OR = 0,
+  // Intersection, everything the triangle doesn't cover gets cleared
+  PIXELS_MASK_AND,
+  // Covered pixels get flipped
+  PIXELS_MASK_XOR,
+} Pixels_Mask_Op;
+
+// Starts out cleared, bits are NULL for an empty size or one too large to allocate
+Pixels_Mask pixels_create_mask(int width, int height);
+void pixels_destroy_mask(Pixels_Mask *mask);
+void pixels_mask_clear(Pixels_Mask *mask);
+#define pixels_mask_get(mask, x, y) ((int)(((mask)->bits[(size_t)(y)*(mask)->words_per_row + ((x) >> 6)] >> ((x) & 63)) & 1))
+
+// Combines the triangle's coverage into the mask, span interiors are written a whole word at a time
+void pixels_render_triangle_mask(Pixels_Mask *mask, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Mask_Op op);
+
+// Destination of encoded bytes, returning false aborts the encode
+typedef bool (*Pixels_Write_Fn)(void *user, const void *data, size_t size);
+
+// Compressed bytes gathered before they go out as one IDAT chunk
+#ifndef PIXELS_PNG_CHUNK_SIZE
+#define PIXELS_PNG_CHUNK_SIZE 65536
+#endif
+#define PIXELS_DEFLATE_WINDOW 32768
+#define PIXELS_DEFLATE_HASH_BITS 15
+
+// LZ77 over a 32K window with fixed Huffman codes, memory use doesn't depend on how much goes through it
+typedef struct {
+  // Two windows worth of input, history in the first half and lookahead in the second
+  unsigned char *window;
+  int32_t *head, *prev;
+  // Next byte to compress and end of the buffered input
+  size_t pos, end;
+  uint64_t bits;
+  int bit_count;
+  unsigned char *out;
+  size_t out_size;
+  uint32_t adler;
+  // How many earlier positions get tried for each match, 0 only looks for runs of the previous byte or pixel
+  int max_chain;
+  Pixels_Write_Fn emit;
+  void *user;
+  bool failed;
+} Pixels_Deflate;
+
+// Streaming RGBA8 PNG encoder, rows get filtered, compressed and written out as they come in so
+// the whole image never has to be in memory. Scratch memory comes from the temp arena and is
+// given back by pixels_png_finish, temp allocations made in between are released with it.
+typedef struct {
+  Pixels_Write_Fn write;
+  void *user;
+  int width, height, rows_written;
+  size_t checkpoint;
+  unsigned char *prev_row, *filtered;
+  Pixels_Deflate z;
+  bool failed;
+} Pixels_Png_Writer;
+
+// Writes to a file descriptor (POSIX only). Both inits fail on an empty width or height.
+bool pixels_png_init(Pixels_Png_Writer *png, int fd, int width, int height);
+bool pixels_png_init_to_func(Pixels_Png_Writer *png, Pixels_Write_Fn write, void *user, int width, int height);
+// Row major straight alpha rows, count of them back to back
+bool pixels_png_write_rows(Pixels_Png_Writer *png, const Pixels_Rgba *rows, int count);
+// Every row of the canvas, tiled and premultiplied canvases get converted a row at a time. Handy as a band sink.
+bool pixels_png_write_canvas(Pixels_Png_Writer *png, const Pixels_Canvas *cnv);
+// False if anything failed along the way or not every row was written
+bool pixels_png_finish(Pixels_Png_Writer *png);
+// Uncompressed bytes per band of the parallel encoder. Band boundaries only depend on the width,
+// so the output is the same no matter how many threads did the work.
+#ifndef PIXELS_PNG_BAND_BYTES
+#define PIXELS_PNG_BAND_BYTES (1024*1024)
+#endif
+#ifndef PIXELS_PNG_MAX_THREADS
+#define PIXELS_PNG_MAX_THREADS 64
+#endif
+
+typedef struct {
+  // 0 means one per CPU
+  int threads;
+  // Preview quality: only repeats of the previous byte or pixel get matched, trading ratio for several times the speed
+  bool fast;
+} Pixels_Png_Opt;
+
+// Rows in each band of the parallel encoder for a given width
+size_t pixels_png_band_rows(int width);
+// Splits the canvas in bands that get filtered and deflated on their own threads (pigz style, each band
+// ends in a sync flush) and then written out in order as IDAT chunks
+bool pixels_encode_png_opt(const Pixels_Canvas *cnv, Pixels_Write_Fn write, void *user, Pixels_Png_Opt opt);
+#define pixels_encode_png(cnv, write, user, ...) pixels_encode_png_opt((cnv), (write), (user), (Pixels_Png_Opt) { __VA_ARGS__ })
+// Whole canvas to a file in one go, through the parallel encoder
+bool pixels_write_png(const char *path, const Pixels_Canvas *cnv);
+// Largest PNG pixels_encode_png_to_buffer can make for the size, enough for a buffer that gets reused for every image.
+// 0 for an empty width or height, the encoder refuses those.
+size_t pixels_png_max_size(int width, int height);
+// Encodes into a buffer the caller owns, scratch comes from the temp arena so nothing is allocated per call.
+// Runs the streaming writer on the calling thread. False with *len at 0 if the image didn't fit.
+bool pixels_encode_png_to_buffer(const Pixels_Canvas *cnv, void *buffer, size_t capacity, size_t *len);
+
+// QOI (https://qoiformat.org) for frames only our own tools read back, Pixels_Rgba is already in its channel order
+#define PIXELS_QOI_HEADER_SIZE 14
+#define PIXELS_QOI_END_SIZE 8
+// Decoder refuses anything bigger, same limit as the reference implementation
+#define PIXELS_QOI_PIXELS_MAX 400000000
+
+// Streams the encoded image through write a chunk at a time, scratch comes from the temp arena. False for an empty image.
+bool pixels_encode_qoi(const Pixels_Canvas *cnv, Pixels_Write_Fn write, void *user);
+bool pixels_write_qoi(const char *path, const Pixels_Canvas *cnv);
+// Same deal as the PNG versions
+size_t pixels_qoi_max_size(int width, int height);
+bool pixels_encode_qoi_to_buffer(const Pixels_Canvas *cnv, void *buffer, size_t capacity, size_t *len);
+// Decodes into a new linear canvas, pixels are NULL if the data isn't a valid QOI image
+Pixels_Canvas pixels_decode_qoi(const void *data, size_t size);
+Pixels_Canvas pixels_read_qoi(const char *path);
+
+typedef enum {
+  // YUV4MPEG2 with 4:2:0 full range BT.601 (C420jpeg, tagged XCOLORRANGE=FULL), what ffmpeg and x264 take on stdin
+  PIXELS_VIDEO_Y4M = 0,
+  // Concatenated binary PPMs (P6), alpha is dropped
+  PIXELS_VIDEO_PPM,
+  // Headerless straight alpha RGBA, ffmpeg -f rawvideo -pixel_format rgba
+  PIXELS_VIDEO_RGBA,
+} Pixels_Video_Format;
+
+typedef struct {
+  Pixels_Video_Format format;
+  // Frame rate as a fraction for the Y4M header, 0 means 30 fps
+  int fps_num, fps_den;
+} Pixels_Video_Opt;
+
+// Writes a sequence of canvases to a file descriptor, usually a pipe into an encoder (POSIX only).
+// Rows go out with writev straight from the canvas when they're already in the right format,
+// everything else gets converted a band of rows at a time.
+typedef struct {
+  int fd;
+  int width, height;
+  Pixels_Video_Opt opt;
+  size_t frames;
+  // Y4M planes or a band of converted rows
+  unsigned char *scratch;
+  bool failed;
+} Pixels_Video_Sink;
+
+// Rows converted per writev for PPM and converted RGBA frames
+#ifndef PIXELS_VIDEO_BAND_ROWS
+#define PIXELS_VIDEO_BAND_ROWS 32
+#endif
+
+bool pixels_video_sink_open_opt(Pixels_Video_Sink *sink, int fd, int width, int height, Pixels_Video_Opt opt);
+#define pixels_video_sink_open(sink, fd, width, height, ...) pixels_video_sink_open_opt((sink), (fd), (width), (height), (Pixels_Video_Opt) { __VA_ARGS__ })
+// The canvas has to be the size the sink was opened with
+bool pixels_video_sink_write(Pixels_Video_Sink *sink, const Pixels_Canvas *cnv);
+// Frees the scratch memory, the fd stays open. False if any frame failed to go out.
+bool pixels_video_sink_close(Pixels_Video_Sink *sink);
+
+// BT.601 full range 4:2:0 from two rows of straight RGBA, chroma is the average of each 2x2 block.
+// row1 can be the same as row0 for the last row of odd heights.
+void pixels_rgba_to_yuv420_rows(const Pixels_Rgba *row0, const Pixels_Rgba *row1, int width, unsigned char *y0, unsigned char *y1, unsigned char *u, unsigned char *v);
+
+typedef enum {
+  PIXELS_IMAGE_PNG = 0,
+  PIXELS_IMAGE_QOI,
+} Pixels_Image_Format;
+
+#ifndef PIXELS_ASYNC_MAX_THREADS
+#define PIXELS_ASYNC_MAX_THREADS 64
+#endif
+
+typedef enum {
+  PIXELS_DEDUP_OFF = 0,
+  // A frame identical to the one before it becomes a hard link to the file of the first frame of the run
+  PIXELS_DEDUP_HARDLINK,
+  // A frame identical to the one before it is a tiny text file "repeat <path>\n" naming the first frame of the run
+  PIXELS_DEDUP_MARKER,
+} Pixels_Dedup_Mode;
+
+typedef struct {
+  Pixels_Image_Format format;
+  // Encoder threads, 0 means one per CPU
+  int threads;
+  // Frames waiting for an encoder before submitting blocks, 0 means two per thread
+  int queue_size;
+  // Fast PNG mode, see Pixels_Png_Opt
+  bool fast;
+  // Frames get hashed on submit and repeats skip the encoder, see pixels_canvas_hash
+  Pixels_Dedup_Mode dedup;
+  // Each encoder thread stages its frames in a Pixels_File_Batch and writes them out together whenever the queue
+  // runs dry or PIXELS_FILE_BATCH_FILES piled up. Pays off for thumbnails and other tiny frames.
+  // Batched PNGs go through the streaming encoder, so fast doesn't apply to them.
+  bool batch_files;
+} Pixels_Async_Writer_Opt;
+
+// Encodes and writes frames to files on background threads while the caller renders the next ones.
+// Canvases come from a pool that's refilled as frames finish writing, so when the encoders fall behind
+// the caller blocks on the pool or the queue instead of piling up frames in memory.
+typedef struct Pixels_Async_Writer Pixels_Async_Writer;
+
+// NULL if it couldn't allocate. Without threads every frame is written right in submit.
+Pixels_Async_Writer *pixels_async_writer_create_opt(int width, int height, Pixels_Async_Writer_Opt opt);
+#define pixels_async_writer_create(width, height, ...) pixels_async_writer_create_opt((width), (height), (Pixels_Async_Writer_Opt) { __VA_ARGS__ })
+// Takes a canvas out of the pool, blocking while every one of them is queued or being written.
+// It still holds whatever frame it had last, clear it if the next one doesn't cover everything.
+bool pixels_async_writer_acquire(Pixels_Async_Writer *writer, Pixels_Canvas *cnv);
+// Queues the canvas to be written to path and takes ownership of it, *cnv is zeroed.
+// Canvases that didn't come from the pool join it if they're the right size.
+bool pixels_async_writer_submit(Pixels_Async_Writer *writer, Pixels_Canvas *cnv, const char *path);
+// Blocks until every submitted frame is written, false if any of them failed so far
+bool pixels_async_writer_wait(Pixels_Async_Writer *writer);
+// Writes whatever is still queued, stops the threads and frees the pool. Same result as pixels_async_writer_wait.
+bool pixels_async_writer_destroy(Pixels_Async_Writer *writer);
+
+#ifndef PIXELS_FILE_BATCH_FILES
+#define PIXELS_FILE_BATCH_FILES 64
+#endif
+#ifndef PIXELS_FILE_BATCH_BYTES
+#define PIXELS_FILE_BATCH_BYTES (8*1024*1024)
+#endif
+
+typedef struct {
+  // Files submitted together, 0 means PIXELS_FILE_BATCH_FILES
+  int files;
+  // Staging buffer for paths and contents, 0 means PIXELS_FILE_BATCH_BYTES
+  size_t buffer_size;
+  // Skip io_uring and write every file with open/write/close
+  bool sync;
+} Pixels_File_Batch_Opt;
+
+// Writes lots of small files (thumbnails, frame dumps) in batches. Contents are staged in one buffer that's
+// registered with io_uring, and each file becomes a linked openat/write/close on a direct descriptor, so a whole
+// batch costs a single io_uring_enter. Falls back to plain synchronous writes when io_uring isn't there.
+typedef struct Pixels_File_Batch Pixels_File_Batch;
+
+// NULL if the staging buffer couldn't be allocated
+Pixels_File_Batch *pixels_file_batch_create_opt(Pixels_File_Batch_Opt opt);
+#define pixels_file_batch_create(...) pixels_file_batch_create_opt((Pixels_File_Batch_Opt) { __VA_ARGS__ })
+// False when it fell back to synchronous writes
+bool pixels_file_batch_uses_io_uring(const Pixels_File_Batch *batch);
+// Copies data into the batch, submitting the pending files first when it doesn't fit
+bool pixels_file_batch_write(Pixels_File_Batch *batch, const char *path, const void *data, size_t size);
+// Encodes the canvas straight into the staging buffer, images bigger than the whole buffer get written on their own
+bool pixels_file_batch_write_image(Pixels_File_Batch *batch, const char *path, const Pixels_Canvas *cnv, Pixels_Image_Format format);
+// Submits the pending files and waits for them. Files are only on disk after this, false if any write failed so far.
+bool pixels_file_batch_flush(Pixels_File_Batch *batch);
+// Flushes and frees everything, same result as pixels_file_batch_flush
+bool pixels_file_batch_destroy(Pixels_File_Batch *batch);
 
 #endif // PIXELS_H_
 
@@ -144,6 +866,147 @@ void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Tri
 
 #ifdef PIXELS_IMPLEMENTATION
 
+#ifdef PIXELS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef PIXELS_SSSE3
+#include <tmmintrin.h>
+#endif
+#ifdef PIXELS_F16C
+#include <immintrin.h>
+#endif
+#ifdef PIXELS_PTHREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+#ifdef PIXELS_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#endif
+#ifdef PIXELS_LINUX_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#endif
+#ifdef PIXELS_IO_URING
+#include <linux/io_uring.h>
+#include <errno.h>
+#endif
+// Strict headers from something included before us, no point in half working mmap paths
+#if defined(PIXELS_LINUX_MMAP) && !defined(MAP_ANONYMOUS)
+#undef PIXELS_LINUX_MMAP
+#undef PIXELS_IO_URING
+#endif
+
+Pixels_Arena pixels_create_arena(size_t capacity) {
+  Pixels_Arena arena = {0};
+  arena.data = PIXELS_MALLOC(capacity);
+  if (arena.data != NULL) {
+    arena.capacity = capacity;
+    arena.owns_data = 1;
+  }
+  return arena;
+}
+
+Pixels_Arena pixels_arena_from_buffer(void *buffer, size_t capacity) {
+  Pixels_Arena arena = {0};
+  arena.data = buffer;
+  arena.capacity = buffer == NULL ? 0 : capacity;
+  return arena;
+}
+
+void pixels_destroy_arena(Pixels_Arena *arena) {
+  if (arena->owns_data) PIXELS_FREE(arena->data);
+  arena->data = NULL;
+  arena->size = arena->capacity = 0;
+  arena->owns_data = 0;
+}
+
+void *pixels_arena_alloc(Pixels_Arena *arena, size_t size) {
+  // Align the address and not the offset, caller buffers don't have to be aligned themselves
+  uintptr_t base = (uintptr_t)arena->data;
+  uintptr_t start = (base + arena->size + (PIXELS_ARENA_ALIGNMENT - 1)) & ~(uintptr_t)(PIXELS_ARENA_ALIGNMENT - 1);
+  size_t offset = start - base;
+  if (offset > arena->capacity || size > arena->capacity - offset) return NULL;
+  arena->size = offset + size;
+  return arena->data + offset;
+}
+
+void pixels_arena_reset(Pixels_Arena *arena) {
+  arena->size = 0;
+}
+
+size_t pixels_arena_save(Pixels_Arena *arena) {
+  return arena->size;
+}
+
+void pixels_arena_rewind(Pixels_Arena *arena, size_t checkpoint) {
+  if (checkpoint < arena->size) arena->size = checkpoint;
+}
+
+static PIXELS_THREAD_LOCAL Pixels_Arena pixels__default_temp_arena = {0};
+static PIXELS_THREAD_LOCAL Pixels_Arena *pixels__temp_arena = NULL;
+
+#ifdef PIXELS_PTHREADS
+// Thread locals don't get destructors in C, a pthread key does. Its value is the default arena's buffer.
+static pthread_key_t pixels__temp_arena_key;
+static pthread_once_t pixels__temp_arena_key_once = PTHREAD_ONCE_INIT;
+
+static void pixels__free_temp_arena_data(void *data) {
+  PIXELS_FREE(data);
+}
+
+static void pixels__create_temp_arena_key(void) {
+  pthread_key_create(&pixels__temp_arena_key, pixels__free_temp_arena_data);
+}
+#endif // PIXELS_PTHREADS
+
+Pixels_Arena *pixels_temp_arena(void) {
+  if (pixels__temp_arena == NULL) {
+    if (pixels__default_temp_arena.data == NULL) {
+      pixels__default_temp_arena = pixels_create_arena(PIXELS_TEMP_CAPACITY);
+#ifdef PIXELS_PTHREADS
+      pthread_once(&pixels__temp_arena_key_once, pixels__create_temp_arena_key);
+      pthread_setspecific(pixels__temp_arena_key, pixels__default_temp_arena.data);
+#endif // PIXELS_PTHREADS
+    }
+    pixels__temp_arena = &pixels__default_temp_arena;
+  }
+  return pixels__temp_arena;
+}
+
+void pixels_release_temp_arena(void) {
+#ifdef PIXELS_PTHREADS
+  if (pixels__default_temp_arena.data != NULL) pthread_setspecific(pixels__temp_arena_key, NULL);
+#endif // PIXELS_PTHREADS
+  if (pixels__temp_arena == &pixels__default_temp_arena) pixels__temp_arena = NULL;
+  pixels_destroy_arena(&pixels__default_temp_arena);
+}
+
+void pixels_set_temp_arena(Pixels_Arena *arena) {
+  pixels__temp_arena = arena;
+}
+
+void *pixels_temp_alloc(size_t size) {
+  return pixels_arena_alloc(pixels_temp_arena(), size);
+}
+
+size_t pixels_temp_save(void) {
+  return pixels_arena_save(pixels_temp_arena());
+}
+
+void pixels_temp_rewind(size_t checkpoint) {
+  pixels_arena_rewind(pixels_temp_arena(), checkpoint);
+}
+
+void pixels_temp_reset(void) {
+  pixels_arena_reset(pixels_temp_arena());
+}
+
 Pixels_Camera pixels_default_camera(size_t width, size_t height) {
   // Not really sure what's a good default for all of these but for now these seem ok
   Pixels_Camera camera = {
@@ -188,75 +1051,543 @@ Pixels_Vector2f pixels_calculate_perspective_projection(Pixels_Camera camera, Pi
 
 // Helper function for creating a new canvas
 Pixels_Canvas pixels_create_canvas(int width, int height) {
-  size_t count = (size_t) width * height;
-  Pixels_Canvas cnv;
+  return pixels_create_canvas_opt(width, height, (Pixels_Canvas_Opt) {0});
+}
+
+Pixels_Canvas pixels_create_canvas_tiled(int width, int height, int tile_shift) {
+  return pixels_create_canvas_opt(width, height, (Pixels_Canvas_Opt) { .tile_shift = tile_shift });
+}
+
+#ifdef PIXELS_LINUX_MMAP
+// Anonymous mapping aligned to PIXELS_HUGE_PAGE_SIZE, explicit huge pages first and transparent ones if none are reserved
+static void *pixels__map_huge(size_t size) {
+#ifdef MAP_HUGETLB
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem != MAP_FAILED) return mem;
+#endif // MAP_HUGETLB
+  // THP only backs aligned ranges, so map an extra page and trim both ends
+  size_t padded = size + PIXELS_HUGE_PAGE_SIZE;
+  unsigned char *raw = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) return NULL;
+  unsigned char *aligned = (unsigned char*)(((uintptr_t)raw + PIXELS_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(PIXELS_HUGE_PAGE_SIZE - 1));
+  if (aligned > raw) munmap(raw, aligned - raw);
+  if (raw + padded > aligned + size) munmap(aligned + size, raw + padded - (aligned + size));
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, size, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+  return aligned;
+}
+#endif // PIXELS_LINUX_MMAP
+
+// Elements stored for the size and layout, tiled canvases pad up to whole tiles. False for empty sizes, unknown
+// layouts or when that many elem_size byte elements plus reserve bytes in front of them wouldn't fit in a size_t.
+static bool pixels__canvas_count(int64_t width, int64_t height, int64_t tile_shift, size_t elem_size, size_t reserve, size_t *count) {
+  if (width <= 0 || height <= 0) return false;
+  if (tile_shift != PIXELS_LAYOUT_LINEAR && tile_shift != PIXELS_LAYOUT_TILE_4X4 && tile_shift != PIXELS_LAYOUT_TILE_8X8) return false;
+  uint64_t tile = (uint64_t)1 << tile_shift;
+  uint64_t padded_w = ((uint64_t)width + tile - 1) & ~(tile - 1);
+  uint64_t padded_h = ((uint64_t)height + tile - 1) & ~(tile - 1);
+  if (padded_w > (SIZE_MAX - reserve)/elem_size/padded_h) return false;
+  *count = (size_t)(padded_w*padded_h);
+  return true;
+}
+
+Pixels_Canvas pixels_create_canvas_opt(int width, int height, Pixels_Canvas_Opt opt) {
+  size_t count;
+  Pixels_Canvas cnv = {0};
+  if (!pixels__canvas_count(width, height, opt.tile_shift, sizeof(Pixels_Rgba), 0, &count)) return cnv;
 
   cnv.width = width;
   cnv.height = height;
   cnv.count = count;
-  cnv.pixels = PIXELS_MALLOC(sizeof(Pixels_Rgba)*count);
-  pixels_foreach_pixel(&cnv, pixel) {
-    pixel->red = pixel->green = pixel->blue = 0;
-    pixel->alpha = 255;
+  cnv.flags = 0;
+  cnv.tile_shift = opt.tile_shift;
+#ifdef PIXELS_LINUX_MMAP
+  if (opt.huge_pages) {
+    size_t size = (sizeof(Pixels_Rgba)*count + PIXELS_HUGE_PAGE_SIZE - 1) & ~(size_t)(PIXELS_HUGE_PAGE_SIZE - 1);
+    cnv.pixels = pixels__map_huge(size);
+    if (cnv.pixels != NULL) {
+      cnv.alloc = PIXELS_ALLOC_MMAP;
+      cnv.alloc_size = size;
+    }
   }
+#endif // PIXELS_LINUX_MMAP
+  if (cnv.pixels == NULL) {
+    cnv.pixels = PIXELS_MALLOC(sizeof(Pixels_Rgba)*count);
+    cnv.alloc = PIXELS_ALLOC_MALLOC;
+  }
+  if (cnv.pixels == NULL) {
+    cnv.count = 0;
+    return cnv;
+  }
+  pixels_canvas_fill(&cnv, (Pixels_Rgba) { 0, 0, 0, 255 }, opt.prefault_threads);
   return cnv;
 }
 
-
-// Calculate the linear interpolation between start and end by a given step
-float pixels_lerpf(float start, float end, float step) {
-  return (end - start) * step + start;
+void pixels_destroy_canvas(Pixels_Canvas *cnv) {
+  switch (cnv->alloc) {
+    case PIXELS_ALLOC_MALLOC:
+      PIXELS_FREE(cnv->pixels);
+      break;
+    case PIXELS_ALLOC_MMAP:
+#ifdef PIXELS_LINUX_MMAP
+      munmap(cnv->pixels, cnv->alloc_size);
+#endif // PIXELS_LINUX_MMAP
+      break;
+    case PIXELS_ALLOC_FILE:
+#ifdef PIXELS_LINUX_MMAP
+      // The mapping starts at the header
+      munmap((unsigned char*)cnv->pixels - PIXELS_MAPPED_HEADER_SIZE, cnv->alloc_size);
+#endif // PIXELS_LINUX_MMAP
+      break;
+    case PIXELS_ALLOC_BORROWED:
+      break;
+  }
+  cnv->pixels = NULL;
+  cnv->count = 0;
 }
 
+Pixels_Canvas pixels_create_canvas_mapped(const char *path, int width, int height) {
+  Pixels_Canvas cnv = {0};
+#ifdef PIXELS_LINUX_MMAP
+  size_t count;
+  if (!pixels__canvas_count(width, height, PIXELS_LAYOUT_LINEAR, sizeof(Pixels_Rgba), PIXELS_MAPPED_HEADER_SIZE, &count)) return cnv;
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return cnv;
+  size_t size = PIXELS_MAPPED_HEADER_SIZE + sizeof(Pixels_Rgba)*count;
+  // Truncating up leaves a sparse file, nothing hits the disk until it gets drawn on
+  unsigned char *mem = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return cnv;
 
-// Computes a scalar cross product for the directed edge from a to b and point p
-// If the returned value is positive, p is to the left of the directed edge of a and b
-// If the returned value is negative, p is to the right of the directed edge of a and b
-// If the returned value is zero, p is sitting on the directed edge of a and b
-float pixels_tri_edge_function(const Pixels_Vector2f *a, const Pixels_Vector2f *b, const Pixels_Vector2f *p) {
-  return (p->x - a->x) * (b->y - a->y) - (p->y - a->y) * (b->x - a->x);
+  cnv.width = width;
+  cnv.height = height;
+  cnv.count = count;
+  cnv.pixels = (Pixels_Rgba*)(mem + PIXELS_MAPPED_HEADER_SIZE);
+  cnv.alloc = PIXELS_ALLOC_FILE;
+  cnv.alloc_size = size;
+
+  Pixels_Mapped_Header *header = (Pixels_Mapped_Header*)mem;
+  memcpy(header->magic, PIXELS_MAPPED_MAGIC, sizeof(header->magic));
+  header->header_size = PIXELS_MAPPED_HEADER_SIZE;
+  header->width = width;
+  header->height = height;
+  header->tile_shift = 0;
+  header->flags = 0;
+  header->count = count;
+#else
+  (void)path;
+  (void)width;
+  (void)height;
+#endif // PIXELS_LINUX_MMAP
+  return cnv;
 }
 
+Pixels_Canvas pixels_open_canvas_mapped(const char *path) {
+  Pixels_Canvas cnv = {0};
+#ifdef PIXELS_LINUX_MMAP
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return cnv;
+  Pixels_Mapped_Header header;
+  struct stat st;
+  // Nothing in the header is trusted, the count has to be exactly what the size and layout need
+  size_t count = 0;
+  bool valid = read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) && fstat(fd, &st) == 0 &&
+               memcmp(header.magic, PIXELS_MAPPED_MAGIC, sizeof(header.magic)) == 0 &&
+               header.header_size == PIXELS_MAPPED_HEADER_SIZE &&
+               pixels__canvas_count(header.width, header.height, header.tile_shift, sizeof(Pixels_Rgba), PIXELS_MAPPED_HEADER_SIZE, &count) &&
+               header.count == count &&
+               (uint64_t)st.st_size >= PIXELS_MAPPED_HEADER_SIZE + sizeof(Pixels_Rgba)*(uint64_t)count;
+  unsigned char *mem = MAP_FAILED;
+  size_t size = PIXELS_MAPPED_HEADER_SIZE + sizeof(Pixels_Rgba)*count;
+  if (valid) mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return cnv;
 
-// Transform a float to an unsigned char rounded up if needed; clamping the value between 0-255
-unsigned char pixels_float_to_uchar_round_clamp(float base_value) {
-  if (base_value <= 0) return 0;
-  if (base_value >= 254.5f) return 255;
-  int v = floorf(base_value + 0.5f);
-  return (unsigned char) v;
+  cnv.width = header.width;
+  cnv.height = header.height;
+  cnv.count = header.count;
+  cnv.pixels = (Pixels_Rgba*)(mem + PIXELS_MAPPED_HEADER_SIZE);
+  cnv.flags = header.flags;
+  cnv.tile_shift = header.tile_shift;
+  cnv.alloc = PIXELS_ALLOC_FILE;
+  cnv.alloc_size = size;
+#else
+  (void)path;
+#endif // PIXELS_LINUX_MMAP
+  return cnv;
 }
 
+bool pixels_canvas_flush(Pixels_Canvas *cnv) {
+  if (cnv->alloc != PIXELS_ALLOC_FILE) return true;
+#ifdef PIXELS_LINUX_MMAP
+  unsigned char *mem = (unsigned char*)cnv->pixels - PIXELS_MAPPED_HEADER_SIZE;
+  // Flags can change after creation (premultiplying the canvas), readers need the current ones
+  Pixels_Mapped_Header *header = (Pixels_Mapped_Header*)mem;
+  header->flags = cnv->flags;
+  return msync(mem, cnv->alloc_size, MS_SYNC) == 0;
+#else
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
 
-// Calculate the eucledian distance between 2 points represented by Vector2f structs but missing the last step of square rooting
-float pixels_square_eucledian_dist_vec2f(Pixels_Vector2f a, Pixels_Vector2f b) {
-  float x = a.x - b.x;
-  float y = a.y - b.y;
-  return (x * x) + (y * y);
+#ifdef PIXELS_LINUX_MMAP
+struct Pixels_Frame_Ring_Header {
+  char magic[8];
+  uint32_t header_size;
+  int32_t width, height;
+  uint32_t slots;
+  uint64_t slot_stride;
+  // Canvas flags of the frame in each slot, written before it gets published
+  uint32_t slot_flags[PIXELS_FRAME_RING_MAX_SLOTS];
+  // Frames published so far, only the producer writes it and the consumer sleeps on it
+  _Alignas(64) _Atomic uint32_t published;
+  _Atomic uint32_t consumer_waiting;
+  // Frames released so far, only the consumer writes it and the producer sleeps on it
+  _Alignas(64) _Atomic uint32_t released;
+  _Atomic uint32_t producer_waiting;
+};
+
+// Shared between processes, so no FUTEX_PRIVATE_FLAG
+static void pixels__futex_wait(_Atomic uint32_t *word, uint32_t value) {
+  syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
 }
 
-// Find the average color based on a point within a triangle 
-Pixels_Rgba pixels_average_vec2f_rgba(Pixels_Vector2f positions[3], Pixels_Rgba colors[3], Pixels_Vector2f point) {
-  // If all colors are the same values then we don't need to compute anything else
-  if (memcmp(colors, colors + 1 , sizeof(Pixels_Rgba)) == 0 && memcmp(colors + 1, colors + 2, sizeof(Pixels_Rgba)) == 0) {
-    return colors[0];
+static void pixels__futex_wake(_Atomic uint32_t *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Returns once the counter moved past stale, sleeping on it if wait is on. The flag lets the other side
+// skip the wake syscall while nobody sleeps; it's set before the last check so a change can't slip in between.
+static bool pixels__ring_wait(_Atomic uint32_t *counter, _Atomic uint32_t *waiting, uint32_t stale, bool wait) {
+  for (;;) {
+    uint32_t value = atomic_load_explicit(counter, memory_order_acquire);
+    if (value != stale) return true;
+    if (!wait) return false;
+    atomic_store(waiting, 1);
+    value = atomic_load(counter);
+    if (value != stale) {
+      atomic_store(waiting, 0);
+      return true;
+    }
+    pixels__futex_wait(counter, value);
   }
+}
 
-  Pixels_Rgba a_clr = colors[0];
-  Pixels_Rgba b_clr = colors[1];
-  Pixels_Rgba c_clr = colors[2];
+static void pixels__ring_signal(_Atomic uint32_t *counter, _Atomic uint32_t *waiting, uint32_t value) {
+  atomic_store(counter, value);
+  if (atomic_exchange(waiting, 0)) pixels__futex_wake(counter);
+}
 
-  Pixels_Vector2f a_pos = positions[0];
-  Pixels_Vector2f b_pos = positions[1];
-  Pixels_Vector2f c_pos = positions[2];
+static Pixels_Canvas pixels__ring_slot(Pixels_Frame_Ring *ring, uint32_t position) {
+  struct Pixels_Frame_Ring_Header *header = ring->header;
+  uint32_t slot = position % header->slots;
+  Pixels_Canvas cnv = {0};
+  cnv.width = header->width;
+  cnv.height = header->height;
+  cnv.count = (size_t)header->width*header->height;
+  cnv.pixels = (Pixels_Rgba*)((unsigned char*)header + PIXELS_FRAME_RING_HEADER_SIZE + slot*header->slot_stride);
+  cnv.flags = header->slot_flags[slot];
+  cnv.alloc = PIXELS_ALLOC_BORROWED;
+  return cnv;
+}
+#endif // PIXELS_LINUX_MMAP
 
-  float dist_a = pixels_square_eucledian_dist_vec2f(point, a_pos);
-  float dist_b = pixels_square_eucledian_dist_vec2f(point, b_pos);
-  float dist_c = pixels_square_eucledian_dist_vec2f(point, c_pos);
-  
-  float max_dist = PIXELS_MAX(PIXELS_MAX(dist_a, dist_b), dist_c);
+bool pixels_frame_ring_create(Pixels_Frame_Ring *ring, const char *name, int width, int height, int slots) {
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+#ifdef PIXELS_LINUX_MMAP
+  size_t count;
+  if (slots < 1 || slots > PIXELS_FRAME_RING_MAX_SLOTS) return false;
+  if (!pixels__canvas_count(width, height, PIXELS_LAYOUT_LINEAR, sizeof(Pixels_Rgba), PIXELS_FRAME_RING_HEADER_SIZE, &count)) return false;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t bytes = sizeof(Pixels_Rgba)*count;
+  if (bytes > SIZE_MAX - (page - 1)) return false;
+  size_t stride = (bytes + page - 1) & ~(page - 1);
+  if (stride > (SIZE_MAX - PIXELS_FRAME_RING_HEADER_SIZE)/slots) return false;
+  size_t size = PIXELS_FRAME_RING_HEADER_SIZE + stride*slots;
+  int fd = name == NULL
+    ? (int)syscall(SYS_memfd_create, "pixels-frame-ring", 0)
+    : shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return false;
+  unsigned char *mem = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
 
-  float step_a = 1.0 -  dist_a / max_dist;
-  float step_b = 1.0 - dist_b / max_dist;
+  // Fresh shm pages are zeroed, so the counters start at 0
+  struct Pixels_Frame_Ring_Header *header = (struct Pixels_Frame_Ring_Header*)mem;
+  header->header_size = PIXELS_FRAME_RING_HEADER_SIZE;
+  header->width = width;
+  header->height = height;
+  header->slots = slots;
+  header->slot_stride = stride;
+  // Magic goes in last, a consumer that sees it sees the rest of the header too
+  atomic_thread_fence(memory_order_release);
+  memcpy(header->magic, PIXELS_FRAME_RING_MAGIC, sizeof(header->magic));
+
+  ring->fd = fd;
+  ring->header = header;
+  ring->map_size = size;
+  return true;
+#else
+  (void)name;
+  (void)width;
+  (void)height;
+  (void)slots;
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
+
+bool pixels_frame_ring_open(Pixels_Frame_Ring *ring, const char *name) {
+#ifdef PIXELS_LINUX_MMAP
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    return false;
+  }
+  bool ok = pixels_frame_ring_open_fd(ring, fd);
+  // Opened by name, so the ring owns this fd
+  if (ok) ring->fd = fd;
+  else close(fd);
+  return ok;
+#else
+  (void)name;
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
+
+bool pixels_frame_ring_open_fd(Pixels_Frame_Ring *ring, int fd) {
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+#ifdef PIXELS_LINUX_MMAP
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < PIXELS_FRAME_RING_HEADER_SIZE) return false;
+  size_t size = st.st_size;
+  unsigned char *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) return false;
+  struct Pixels_Frame_Ring_Header *header = (struct Pixels_Frame_Ring_Header*)mem;
+  bool valid = memcmp(header->magic, PIXELS_FRAME_RING_MAGIC, sizeof(header->magic)) == 0;
+  atomic_thread_fence(memory_order_acquire);
+  valid = valid && header->header_size == PIXELS_FRAME_RING_HEADER_SIZE &&
+          header->slots >= 1 && header->slots <= PIXELS_FRAME_RING_MAX_SLOTS;
+  // The slots get handed out as width*height canvases, so every one of them has to fit in the mapping
+  size_t count;
+  valid = valid && pixels__canvas_count(header->width, header->height, PIXELS_LAYOUT_LINEAR, sizeof(Pixels_Rgba), 0, &count) &&
+          sizeof(Pixels_Rgba)*count <= header->slot_stride &&
+          header->slot_stride <= (size - PIXELS_FRAME_RING_HEADER_SIZE)/header->slots;
+  if (!valid) {
+    munmap(mem, size);
+    return false;
+  }
+  ring->header = header;
+  ring->map_size = size;
+  // Frames published before the consumer showed up are still waiting for it
+  ring->position = atomic_load(&header->released);
+  return true;
+#else
+  (void)fd;
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
+
+void pixels_frame_ring_close(Pixels_Frame_Ring *ring) {
+#ifdef PIXELS_LINUX_MMAP
+  if (ring->header != NULL) munmap(ring->header, ring->map_size);
+  if (ring->fd >= 0) close(ring->fd);
+#endif // PIXELS_LINUX_MMAP
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+bool pixels_frame_ring_acquire(Pixels_Frame_Ring *ring, Pixels_Canvas *cnv, bool wait) {
+#ifdef PIXELS_LINUX_MMAP
+  struct Pixels_Frame_Ring_Header *header = ring->header;
+  // The slot is free once the frame that used it last time around got released
+  if (!pixels__ring_wait(&header->released, &header->producer_waiting, ring->position - header->slots, wait)) return false;
+  *cnv = pixels__ring_slot(ring, ring->position);
+  cnv->flags = 0;
+  ring->holding = true;
+  return true;
+#else
+  (void)ring;
+  (void)cnv;
+  (void)wait;
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
+
+void pixels_frame_ring_publish(Pixels_Frame_Ring *ring, const Pixels_Canvas *cnv) {
+#ifdef PIXELS_LINUX_MMAP
+  if (!ring->holding) return;
+  struct Pixels_Frame_Ring_Header *header = ring->header;
+  header->slot_flags[ring->position % header->slots] = cnv->flags;
+  ring->position += 1;
+  ring->holding = false;
+  pixels__ring_signal(&header->published, &header->consumer_waiting, ring->position);
+#else
+  (void)ring;
+  (void)cnv;
+#endif // PIXELS_LINUX_MMAP
+}
+
+bool pixels_frame_ring_next(Pixels_Frame_Ring *ring, Pixels_Canvas *cnv, bool wait) {
+#ifdef PIXELS_LINUX_MMAP
+  struct Pixels_Frame_Ring_Header *header = ring->header;
+  if (!pixels__ring_wait(&header->published, &header->consumer_waiting, ring->position, wait)) return false;
+  *cnv = pixels__ring_slot(ring, ring->position);
+  ring->holding = true;
+  return true;
+#else
+  (void)ring;
+  (void)cnv;
+  (void)wait;
+  return false;
+#endif // PIXELS_LINUX_MMAP
+}
+
+void pixels_frame_ring_release(Pixels_Frame_Ring *ring) {
+#ifdef PIXELS_LINUX_MMAP
+  if (!ring->holding) return;
+  ring->position += 1;
+  ring->holding = false;
+  pixels__ring_signal(&ring->header->released, &ring->header->producer_waiting, ring->position);
+#else
+  (void)ring;
+#endif // PIXELS_LINUX_MMAP
+}
+
+typedef struct {
+  Pixels_Rgba *pixels;
+  size_t count;
+  Pixels_Rgba color;
+} Pixels__Fill_Job;
+
+static void *pixels__fill_job(void *arg) {
+  Pixels__Fill_Job *job = arg;
+  for (size_t i = 0; i < job->count; ++i) job->pixels[i] = job->color;
+  return NULL;
+}
+
+void pixels_canvas_fill(Pixels_Canvas *cnv, Pixels_Rgba color, int threads) {
+  // Rows of storage, tiled canvases keep a whole row of tiles together
+  size_t rows = ((size_t)cnv->height + ((size_t)1 << cnv->tile_shift) - 1) >> cnv->tile_shift;
+  size_t row_count = rows == 0 ? 0 : cnv->count / rows;
+  Pixels__Fill_Job jobs[64];
+#ifdef PIXELS_PTHREADS
+  if (threads <= 0) {
+    threads = 1;
+    if (sizeof(Pixels_Rgba)*cnv->count >= PIXELS_PARALLEL_TOUCH_MIN) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  threads = PIXELS_CLAMP(threads, 1, (int)PIXELS_ARRAY_LEN(jobs));
+  if ((size_t)threads > rows) threads = rows == 0 ? 1 : (int)rows;
+#else
+  threads = 1;
+#endif // PIXELS_PTHREADS
+
+  for (int i = 0; i < threads; ++i) {
+    size_t first = rows*i/threads, last = rows*(i + 1)/threads;
+    jobs[i] = (Pixels__Fill_Job) { cnv->pixels + first*row_count, (last - first)*row_count, color };
+  }
+#ifdef PIXELS_PTHREADS
+  pthread_t workers[PIXELS_ARRAY_LEN(jobs)];
+  bool started[PIXELS_ARRAY_LEN(jobs)] = {0};
+  for (int i = 1; i < threads; ++i) started[i] = pthread_create(&workers[i], NULL, pixels__fill_job, &jobs[i]) == 0;
+  pixels__fill_job(&jobs[0]);
+  for (int i = 1; i < threads; ++i) {
+    // Couldn't get a thread, do the band here instead
+    if (started[i]) pthread_join(workers[i], NULL);
+    else pixels__fill_job(&jobs[i]);
+  }
+#else
+  pixels__fill_job(&jobs[0]);
+#endif // PIXELS_PTHREADS
+}
+
+
+void pixels_canvas_linearize(const Pixels_Canvas *cnv, Pixels_Rgba *out) {
+  if (cnv->tile_shift == 0) {
+    memcpy(out, cnv->pixels, sizeof(Pixels_Rgba)*cnv->width*cnv->height);
+    return;
+  }
+  // Each tile row is contiguous on both sides, so copy those a tile width at a time
+  int tile = 1 << cnv->tile_shift;
+  for (int y = 0; y < cnv->height; ++y) {
+    for (int x = 0; x < cnv->width; x += tile) {
+      int n = PIXELS_MIN(tile, cnv->width - x);
+      memcpy(out + (size_t)y*cnv->width + x, pixels_get_pixel(cnv, x, y), sizeof(Pixels_Rgba)*n);
+    }
+  }
+}
+
+// Pixels starting at column x that are next to each other in memory, stopping at end
+static inline int pixels__contiguous_run(const Pixels_Canvas *cnv, int x, int end) {
+  if (cnv->tile_shift == 0) return end - x;
+  int tile_end = (x | ((1 << cnv->tile_shift) - 1)) + 1;
+  return PIXELS_MIN(end, tile_end) - x;
+}
+
+
+// Calculate the linear interpolation between start and end by a given step
+float pixels_lerpf(float start, float end, float step) {
+  return (end - start) * step + start;
+}
+
+
+// Computes a scalar cross product for the directed edge from a to b and point p
+// If the returned value is positive, p is to the left of the directed edge of a and b
+// If the returned value is negative, p is to the right of the directed edge of a and b
+// If the returned value is zero, p is sitting on the directed edge of a and b
+float pixels_tri_edge_function(const Pixels_Vector2f *a, const Pixels_Vector2f *b, const Pixels_Vector2f *p) {
+  return (p->x - a->x) * (b->y - a->y) - (p->y - a->y) * (b->x - a->x);
+}
+
+
+// Transform a float to an unsigned char rounded up if needed; clamping the value between 0-255
+unsigned char pixels_float_to_uchar_round_clamp(float base_value) {
+  if (base_value <= 0) return 0;
+  if (base_value >= 254.5f) return 255;
+  int v = floorf(base_value + 0.5f);
+  return (unsigned char) v;
+}
+
+
+// Calculate the eucledian distance between 2 points represented by Vector2f structs but missing the last step of square rooting
+float pixels_square_eucledian_dist_vec2f(Pixels_Vector2f a, Pixels_Vector2f b) {
+  float x = a.x - b.x;
+  float y = a.y - b.y;
+  return (x * x) + (y * y);
+}
+
+// Find the average color based on a point within a triangle 
+Pixels_Rgba pixels_average_vec2f_rgba(Pixels_Vector2f positions[3], Pixels_Rgba colors[3], Pixels_Vector2f point) {
+  // If all colors are the same values then we don't need to compute anything else
+  if (memcmp(colors, colors + 1 , sizeof(Pixels_Rgba)) == 0 && memcmp(colors + 1, colors + 2, sizeof(Pixels_Rgba)) == 0) {
+    return colors[0];
+  }
+
+  Pixels_Rgba a_clr = colors[0];
+  Pixels_Rgba b_clr = colors[1];
+  Pixels_Rgba c_clr = colors[2];
+
+  Pixels_Vector2f a_pos = positions[0];
+  Pixels_Vector2f b_pos = positions[1];
+  Pixels_Vector2f c_pos = positions[2];
+
+  float dist_a = pixels_square_eucledian_dist_vec2f(point, a_pos);
+  float dist_b = pixels_square_eucledian_dist_vec2f(point, b_pos);
+  float dist_c = pixels_square_eucledian_dist_vec2f(point, c_pos);
+  
+  float max_dist = PIXELS_MAX(PIXELS_MAX(dist_a, dist_b), dist_c);
+
+  float step_a = 1.0 -  dist_a / max_dist;
+  float step_b = 1.0 - dist_b / max_dist;
   float step_c = 1.0 - dist_c / max_dist;
 
   unsigned char min_r = PIXELS_MIN(PIXELS_MIN(a_clr.red, b_clr.red), c_clr.red);
@@ -340,7 +1671,286 @@ Pixels_Rgba pixels_barycentric_trilerp(Pixels_Vector2f p[3], Pixels_Rgba color[3
 }
 
 
-void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Triangle tri) {
+static void pixels__blend_span_scalar(Pixels_Rgba *dst, const Pixels_Rgba *src, size_t count, Pixels_Blend_Mode mode) {
+  // Every mode except add boils down to div255(src*fs + dst*fd) per channel, the SIMD kernel relies on it
+#define PIXELS__BLEND_CHANNEL(s, fs, d, fd) (unsigned char) PIXELS_MIN(PIXELS_DIV255((s)*(fs) + (d)*(fd)), 255u)
+  switch (mode) {
+  case PIXELS_BLEND_REPLACE:
+    memcpy(dst, src, sizeof(Pixels_Rgba)*count);
+    break;
+  case PIXELS_BLEND_SRC_OVER:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      unsigned int sa = s.alpha, ia = 255 - sa;
+      if (d.alpha == 255) {
+        dst[i].red   = PIXELS__BLEND_CHANNEL(s.red, sa, d.red, ia);
+        dst[i].green = PIXELS__BLEND_CHANNEL(s.green, sa, d.green, ia);
+        dst[i].blue  = PIXELS__BLEND_CHANNEL(s.blue, sa, d.blue, ia);
+        dst[i].alpha = 255;
+        continue;
+      }
+      // Weights in 255*255 units so nothing is rounded before the divide, they add up to the new alpha.
+      // With an opaque destination this comes out exactly like the branch above.
+      unsigned int ws = sa*255, wd = d.alpha*ia, oa = ws + wd;
+      if (oa == 0) {
+        dst[i] = (Pixels_Rgba) { 0, 0, 0, 0 };
+        continue;
+      }
+      dst[i].red   = (s.red*ws + d.red*wd + oa/2) / oa;
+      dst[i].green = (s.green*ws + d.green*wd + oa/2) / oa;
+      dst[i].blue  = (s.blue*ws + d.blue*wd + oa/2) / oa;
+      dst[i].alpha = PIXELS_DIV255(oa);
+    }
+    break;
+  case PIXELS_BLEND_SRC_OVER_PREMUL:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      unsigned int ia = 255 - s.alpha;
+      dst[i].red   = PIXELS__BLEND_CHANNEL(s.red, 255u, d.red, ia);
+      dst[i].green = PIXELS__BLEND_CHANNEL(s.green, 255u, d.green, ia);
+      dst[i].blue  = PIXELS__BLEND_CHANNEL(s.blue, 255u, d.blue, ia);
+      dst[i].alpha = PIXELS__BLEND_CHANNEL(s.alpha, 255u, d.alpha, ia);
+    }
+    break;
+  case PIXELS_BLEND_ADD:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      unsigned int sa = s.alpha;
+      dst[i].red   = PIXELS_MIN(d.red + PIXELS_DIV255(s.red*sa), 255u);
+      dst[i].green = PIXELS_MIN(d.green + PIXELS_DIV255(s.green*sa), 255u);
+      dst[i].blue  = PIXELS_MIN(d.blue + PIXELS_DIV255(s.blue*sa), 255u);
+      dst[i].alpha = PIXELS_MIN(d.alpha + sa, 255u);
+    }
+    break;
+  case PIXELS_BLEND_MULTIPLY:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      unsigned int sa = s.alpha, ia = 255 - sa;
+      dst[i].red   = PIXELS__BLEND_CHANNEL(0u, 0u, d.red, PIXELS_DIV255(s.red*sa) + ia);
+      dst[i].green = PIXELS__BLEND_CHANNEL(0u, 0u, d.green, PIXELS_DIV255(s.green*sa) + ia);
+      dst[i].blue  = PIXELS__BLEND_CHANNEL(0u, 0u, d.blue, PIXELS_DIV255(s.blue*sa) + ia);
+      dst[i].alpha = PIXELS__BLEND_CHANNEL(sa, 255u, d.alpha, ia);
+    }
+    break;
+  case PIXELS_BLEND_ADD_PREMUL:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      dst[i].red   = PIXELS_MIN(d.red + s.red, 255);
+      dst[i].green = PIXELS_MIN(d.green + s.green, 255);
+      dst[i].blue  = PIXELS_MIN(d.blue + s.blue, 255);
+      dst[i].alpha = PIXELS_MIN(d.alpha + s.alpha, 255);
+    }
+    break;
+  case PIXELS_BLEND_MULTIPLY_PREMUL:
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba s = src[i], d = dst[i];
+      unsigned int sa = s.alpha, ia = 255 - sa;
+      dst[i].red   = PIXELS__BLEND_CHANNEL(0u, 0u, d.red, PIXELS_MIN(s.red + ia, 255u));
+      dst[i].green = PIXELS__BLEND_CHANNEL(0u, 0u, d.green, PIXELS_MIN(s.green + ia, 255u));
+      dst[i].blue  = PIXELS__BLEND_CHANNEL(0u, 0u, d.blue, PIXELS_MIN(s.blue + ia, 255u));
+      dst[i].alpha = PIXELS__BLEND_CHANNEL(sa, 255u, d.alpha, ia);
+    }
+    break;
+  }
+#undef PIXELS__BLEND_CHANNEL
+}
+
+#ifdef PIXELS_SSE2
+// Same rounding as PIXELS_DIV255 but saturating, so out of range premultiplied colors clamp to 255 like the scalar path
+static inline __m128i pixels__sse2_div255(__m128i x) {
+  x = _mm_adds_epu16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_adds_epu16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Blends 2 pixels held as 16 bit lanes [r g b a r g b a]
+static inline __m128i pixels__sse2_blend_2px(__m128i s, __m128i d, Pixels_Blend_Mode mode) {
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i c255 = _mm_set1_epi16(255);
+  __m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+  __m128i ia = _mm_sub_epi16(c255, sa);
+  // Source alpha on the color lanes and 255 on the alpha lane
+  __m128i sa_color = _mm_or_si128(_mm_andnot_si128(alpha_lanes, sa), _mm_and_si128(alpha_lanes, c255));
+  __m128i fs, fd;
+  switch (mode) {
+  case PIXELS_BLEND_SRC_OVER:
+    fs = sa_color;
+    fd = ia;
+    break;
+  case PIXELS_BLEND_SRC_OVER_PREMUL:
+    fs = c255;
+    fd = ia;
+    break;
+  case PIXELS_BLEND_MULTIPLY:
+    fs = _mm_and_si128(alpha_lanes, c255);
+    fd = _mm_add_epi16(_mm_andnot_si128(alpha_lanes, pixels__sse2_div255(_mm_mullo_epi16(s, sa))), ia);
+    break;
+  case PIXELS_BLEND_MULTIPLY_PREMUL:
+    fs = _mm_and_si128(alpha_lanes, c255);
+    fd = _mm_min_epi16(_mm_add_epi16(_mm_andnot_si128(alpha_lanes, s), ia), c255);
+    break;
+  case PIXELS_BLEND_ADD:
+    // Only the weighted source is computed here, the saturating add happens on the packed bytes
+    return pixels__sse2_div255(_mm_mullo_epi16(s, sa_color));
+  case PIXELS_BLEND_ADD_PREMUL:
+    return s;
+  default:
+    return s;
+  }
+  return pixels__sse2_div255(_mm_adds_epu16(_mm_mullo_epi16(s, fs), _mm_mullo_epi16(d, fd)));
+}
+
+static inline __m128i pixels__sse2_blend_4px(__m128i s, __m128i d, Pixels_Blend_Mode mode) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = pixels__sse2_blend_2px(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), mode);
+  __m128i hi = pixels__sse2_blend_2px(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), mode);
+  __m128i out = _mm_packus_epi16(lo, hi);
+  if (mode == PIXELS_BLEND_ADD || mode == PIXELS_BLEND_ADD_PREMUL) out = _mm_adds_epu8(out, d);
+  return out;
+}
+
+static inline __m128i pixels__sse2_premultiply_4px(__m128i px) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  __m128i lo = _mm_unpacklo_epi8(px, zero);
+  __m128i hi = _mm_unpackhi_epi8(px, zero);
+  // Alpha multiplies itself by 255 so it comes out unchanged
+  __m128i lo_a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+  __m128i hi_a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+  lo_a = _mm_or_si128(_mm_andnot_si128(alpha_lanes, lo_a), _mm_and_si128(alpha_lanes, _mm_set1_epi16(255)));
+  hi_a = _mm_or_si128(_mm_andnot_si128(alpha_lanes, hi_a), _mm_and_si128(alpha_lanes, _mm_set1_epi16(255)));
+  lo = pixels__sse2_div255(_mm_mullo_epi16(lo, lo_a));
+  hi = pixels__sse2_div255(_mm_mullo_epi16(hi, hi_a));
+  return _mm_packus_epi16(lo, hi);
+}
+#endif // PIXELS_SSE2
+
+#ifdef PIXELS_SSE2
+// Straight source-over only has a SIMD kernel for opaque destinations, anything else needs the scalar division
+static inline bool pixels__sse2_needs_scalar(__m128i d, Pixels_Blend_Mode mode) {
+  const __m128i alpha_bytes = _mm_set1_epi32((int)0xFF000000u);
+  return mode == PIXELS_BLEND_SRC_OVER && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(d, alpha_bytes), alpha_bytes)) != 0xFFFF;
+}
+#endif // PIXELS_SSE2
+
+void pixels_blend_span(Pixels_Rgba *dst, const Pixels_Rgba *src, size_t count, Pixels_Blend_Mode mode) {
+  size_t i = 0;
+#ifdef PIXELS_SSE2
+  if (mode != PIXELS_BLEND_REPLACE) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i s0 = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i s1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+      __m128i d0 = _mm_loadu_si128((const __m128i*)(dst + i));
+      __m128i d1 = _mm_loadu_si128((const __m128i*)(dst + i + 4));
+      if (pixels__sse2_needs_scalar(_mm_and_si128(d0, d1), mode)) {
+        pixels__blend_span_scalar(dst + i, src + i, 8, mode);
+        continue;
+      }
+      _mm_storeu_si128((__m128i*)(dst + i), pixels__sse2_blend_4px(s0, d0, mode));
+      _mm_storeu_si128((__m128i*)(dst + i + 4), pixels__sse2_blend_4px(s1, d1, mode));
+    }
+    // 4x4 tiles hand over spans of 4
+    if (i + 4 <= count) {
+      __m128i s0 = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i d0 = _mm_loadu_si128((const __m128i*)(dst + i));
+      if (pixels__sse2_needs_scalar(d0, mode)) pixels__blend_span_scalar(dst + i, src + i, 4, mode);
+      else _mm_storeu_si128((__m128i*)(dst + i), pixels__sse2_blend_4px(s0, d0, mode));
+      i += 4;
+    }
+  }
+#endif // PIXELS_SSE2
+  pixels__blend_span_scalar(dst + i, src + i, count - i, mode);
+}
+
+
+void pixels_premultiply_span(Pixels_Rgba *pixels, size_t count) {
+  size_t i = 0;
+#ifdef PIXELS_SSE2
+  for (; i + 8 <= count; i += 8) {
+    __m128i p0 = _mm_loadu_si128((const __m128i*)(pixels + i));
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(pixels + i + 4));
+    _mm_storeu_si128((__m128i*)(pixels + i), pixels__sse2_premultiply_4px(p0));
+    _mm_storeu_si128((__m128i*)(pixels + i + 4), pixels__sse2_premultiply_4px(p1));
+  }
+#endif // PIXELS_SSE2
+  for (; i < count; ++i) {
+    unsigned int a = pixels[i].alpha;
+    pixels[i].red   = PIXELS_DIV255(pixels[i].red*a);
+    pixels[i].green = PIXELS_DIV255(pixels[i].green*a);
+    pixels[i].blue  = PIXELS_DIV255(pixels[i].blue*a);
+  }
+}
+
+// 16.16 reciprocal of an alpha, 0 stays 0. Spelled out by the preprocessor so the table is constant
+// and there's nothing to build at runtime.
+#define PIXELS__RECIP(a) ((a) ? ((255u << 16) + (a)/2) / ((a) + !(a)) : 0u)
+#define PIXELS__RECIP4(a) PIXELS__RECIP(a), PIXELS__RECIP((a) + 1), PIXELS__RECIP((a) + 2), PIXELS__RECIP((a) + 3)
+#define PIXELS__RECIP16(a) PIXELS__RECIP4(a), PIXELS__RECIP4((a) + 4), PIXELS__RECIP4((a) + 8), PIXELS__RECIP4((a) + 12)
+#define PIXELS__RECIP64(a) PIXELS__RECIP16(a), PIXELS__RECIP16((a) + 16), PIXELS__RECIP16((a) + 32), PIXELS__RECIP16((a) + 48)
+
+void pixels_unpremultiply_span(Pixels_Rgba *dst, const Pixels_Rgba *src, size_t count) {
+  // Reciprocals of every alpha so un-premultiplying is a multiply and a shift
+  static const unsigned int recip[256] = {
+    PIXELS__RECIP64(0u), PIXELS__RECIP64(64u), PIXELS__RECIP64(128u), PIXELS__RECIP64(192u),
+  };
+  for (size_t i = 0; i < count; ++i) {
+    Pixels_Rgba p = src[i];
+    unsigned int r = recip[p.alpha];
+    dst[i].red   = PIXELS_MIN((p.red*r + (1u << 15)) >> 16, 255u);
+    dst[i].green = PIXELS_MIN((p.green*r + (1u << 15)) >> 16, 255u);
+    dst[i].blue  = PIXELS_MIN((p.blue*r + (1u << 15)) >> 16, 255u);
+    dst[i].alpha = p.alpha;
+  }
+}
+
+void pixels_canvas_premultiply(Pixels_Canvas *cnv) {
+  if (cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) return;
+  pixels_premultiply_span(cnv->pixels, cnv->count);
+  cnv->flags |= PIXELS_CANVAS_PREMULTIPLIED;
+}
+
+void pixels_canvas_unpremultiply(Pixels_Canvas *cnv) {
+  if (!(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED)) return;
+  pixels_unpremultiply_span(cnv->pixels, cnv->pixels, cnv->count);
+  cnv->flags &= ~PIXELS_CANVAS_PREMULTIPLIED;
+}
+
+void pixels_canvas_export_straight(const Pixels_Canvas *cnv, Pixels_Rgba *out) {
+  if (cnv->tile_shift != 0) {
+    pixels_canvas_linearize(cnv, out);
+    if (cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) pixels_unpremultiply_span(out, out, (size_t)cnv->width*cnv->height);
+  } else if (cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) {
+    pixels_unpremultiply_span(out, cnv->pixels, cnv->count);
+  } else {
+    memcpy(out, cnv->pixels, sizeof(Pixels_Rgba)*cnv->count);
+  }
+}
+
+// Premultiplied canvases get premultiplied sources, straight modes are swapped for their premultiplied versions
+static Pixels_Blend_Mode pixels__premultiplied_blend_mode(Pixels_Blend_Mode mode) {
+  switch (mode) {
+  case PIXELS_BLEND_SRC_OVER: return PIXELS_BLEND_SRC_OVER_PREMUL;
+  case PIXELS_BLEND_ADD:      return PIXELS_BLEND_ADD_PREMUL;
+  case PIXELS_BLEND_MULTIPLY: return PIXELS_BLEND_MULTIPLY_PREMUL;
+  default: return mode;
+  }
+}
+
+static int pixels__blend_mode_is_premultiplied(Pixels_Blend_Mode mode) {
+  return mode == PIXELS_BLEND_SRC_OVER_PREMUL || mode == PIXELS_BLEND_ADD_PREMUL || mode == PIXELS_BLEND_MULTIPLY_PREMUL;
+}
+
+// Triangle after projection, shared by every rasterization target
+typedef struct {
+  Pixels_Vector2f p[3];
+  Pixels_Rgba color[3];
+  float area;
+  // Bounding box already clamped to the target, x1 and y1 are exclusive
+  int x0, y0, x1, y1;
+} Pixels__Raster_Tri;
+
+// Projects the triangle and clamps its bounding box to width x height starting at row origin_y,
+// false means there's nothing to draw
+static bool pixels__setup_triangle(Pixels__Raster_Tri *rt, int width, int height, int origin_y, Pixels_Camera camera, Pixels_Triangle tri) {
   Pixels_Vector2f a = pixels_calculate_perspective_projection(camera, tri.a.position);
   Pixels_Vector2f b = pixels_calculate_perspective_projection(camera, tri.b.position);
   Pixels_Vector2f c = pixels_calculate_perspective_projection(camera, tri.c.position);
@@ -358,10 +1968,10 @@ void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Tri
   if (isinf(maxy)) maxy = signbit(maxy) == 0 ? FLT_MAX : -FLT_MAX;
 
   // Ignore tri if bounding box does not overlap canvas
-  if (maxx < 0.0f || minx >= (float)cnv->width ||
-  maxy < 0.0f || miny >= (float)cnv->height) {
+  if (maxx < 0.0f || minx >= (float)width ||
+  maxy < (float)origin_y || miny >= (float)origin_y + height) {
     // printf("Triangle is out of bounds so it was skipped");
-    return;
+    return false;
   }
 
 
@@ -371,10 +1981,10 @@ void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Tri
   int y1 = (int)ceilf(maxy);
 
   if (x0 < 0) x0 = 0;
-  if (y0 < 0) y0 = 0;
-  if (x1 > cnv->width)  x1 = cnv->width;
-  if (y1 > cnv->height) y1 = cnv->height;
-  if (x0 >= x1 || y0 >= y1) return;
+  if (y0 < origin_y) y0 = origin_y;
+  if (x1 > width)  x1 = width;
+  if (y1 > origin_y + height) y1 = origin_y + height;
+  if (x0 >= x1 || y0 >= y1) return false;
 
   // printf("BBox { %.2f, %.2f, %.2f, %.2f }\n", minx, miny, maxx, maxy);
   // printf("Points { (%d, %d), (%d, %d) }\n", x0, y0, x1, y1);
@@ -383,28 +1993,355 @@ void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Tri
   float eps = 1e-32f;
   if (fabsf(area) < eps) {
     // printf("Triangle is a 'degenerate tri' so it was skipped");
-    return; // Chat-GPT says this is called a "degenerate tri"
-  }
-
-  for (int y = y0; y < y1; ++y) {
-    for (int x = x0; x < x1; ++x) {
-      Pixels_Vector2f p = { x + 0.5f, y + 0.5f };
-      float w0 = pixels_tri_edge_function(&b, &c, &p);
-      float w1 = pixels_tri_edge_function(&c, &a, &p);
-      float w2 = pixels_tri_edge_function(&a, &b, &p);
-
-      // Point is inside if all edge functions have the same sign as area
-      if ((w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f && area > 0.0f) ||
-      (w0 <= 0.0f && w1 <= 0.0f && w2 <= 0.0f && area < 0.0f)) {
-	Pixels_Vector2f pt = { x, y };
-	Pixels_Vector2f ps[3] = { a, b, c };
-	Pixels_Rgba cs[3] = { tri.a.color, tri.b.color, tri.c.color };
-	Pixels_Rgba fill_color = pixels_barycentric_trilerp(ps, cs, pt);
-	// printf("A"Pixels_RGB_Fmt" ~ "Pixels_RGB_Fmt" ~ "Pixels_RGB_Fmt" -> "Pixels_RGB_Fmt"\n", Pixels_RGB_Arg(tri.a.color), Pixels_RGB_Arg(tri.b.color), Pixels_RGB_Arg(tri.c.color), Pixels_RGB_Arg(fill_color));
-        pixels_set_pixel(cnv, x, y, fill_color);
+    return false; // Chat-GPT says this is called a "degenerate tri"
+  }
+
+  rt->p[0] = a;
+  rt->p[1] = b;
+  rt->p[2] = c;
+  rt->color[0] = tri.a.color;
+  rt->color[1] = tri.b.color;
+  rt->color[2] = tri.c.color;
+  rt->area = area;
+  rt->x0 = x0;
+  rt->y0 = y0;
+  rt->x1 = x1;
+  rt->y1 = y1;
+  return true;
+}
+
+static inline bool pixels__raster_covers(const Pixels__Raster_Tri *rt, int x, int y) {
+  Pixels_Vector2f p = { x + 0.5f, y + 0.5f };
+  float w0 = pixels_tri_edge_function(&rt->p[1], &rt->p[2], &p);
+  float w1 = pixels_tri_edge_function(&rt->p[2], &rt->p[0], &p);
+  float w2 = pixels_tri_edge_function(&rt->p[0], &rt->p[1], &p);
+
+  // Point is inside if all edge functions have the same sign as area
+  return (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f && rt->area > 0.0f) ||
+         (w0 <= 0.0f && w1 <= 0.0f && w2 <= 0.0f && rt->area < 0.0f);
+}
+
+// Same as pixels__raster_next_run but stops looking at column x_end
+static bool pixels__raster_next_run_until(const Pixels__Raster_Tri *rt, int y, int x_end, int *x, int *run_end) {
+  int cx = *x;
+  while (cx < x_end && !pixels__raster_covers(rt, cx, y)) ++cx;
+  if (cx >= x_end) return false;
+  *x = cx;
+  while (cx < x_end && pixels__raster_covers(rt, cx, y)) ++cx;
+  *run_end = cx;
+  return true;
+}
+
+// Finds the next run of covered pixels in row y starting from *x, leaving it in [*x, *run_end).
+// Returns false once the row has no more covered pixels.
+static bool pixels__raster_next_run(const Pixels__Raster_Tri *rt, int y, int *x, int *run_end) {
+  return pixels__raster_next_run_until(rt, y, rt->x1, x, run_end);
+}
+
+// Position d along a curve filling a 2^order x 2^order square
+static void pixels__curve_decode(Pixels_Traversal traversal, int order, uint32_t d, uint32_t *x, uint32_t *y) {
+  uint32_t cx = 0, cy = 0;
+  if (traversal == PIXELS_TRAVERSAL_MORTON) {
+    // Even bits are x and odd bits are y
+    for (int bit = 0; bit < order; ++bit) {
+      cx |= ((d >> (2*bit)) & 1) << bit;
+      cy |= ((d >> (2*bit + 1)) & 1) << bit;
+    }
+  } else {
+    // https://en.wikipedia.org/wiki/Hilbert_curve#Applications_and_mapping_algorithms
+    uint32_t t = d;
+    for (uint32_t s = 1; s < ((uint32_t)1 << order); s *= 2) {
+      uint32_t rx = 1 & (t / 2);
+      uint32_t ry = 1 & (t ^ rx);
+      if (ry == 0) {
+        if (rx == 1) {
+          cx = s - 1 - cx;
+          cy = s - 1 - cy;
+        }
+        uint32_t tmp = cx;
+        cx = cy;
+        cy = tmp;
+      }
+      cx += s * rx;
+      cy += s * ry;
+      t /= 4;
+    }
+  }
+  *x = cx;
+  *y = cy;
+}
+
+// Smallest order whose square covers a tiles_x x tiles_y grid
+static int pixels__curve_order(int tiles_x, int tiles_y) {
+  int side = PIXELS_MAX(tiles_x, tiles_y), order = 0;
+  while ((1 << order) < side) ++order;
+  return order;
+}
+
+void pixels_tile_order(Pixels_Traversal traversal, int tiles_x, int tiles_y, uint32_t *out) {
+  size_t n = 0;
+  if (traversal == PIXELS_TRAVERSAL_ROWS) {
+    for (int i = 0; i < tiles_x*tiles_y; ++i) out[n++] = i;
+    return;
+  }
+  // Walk the covering square and drop whatever falls outside of the grid
+  int order = pixels__curve_order(tiles_x, tiles_y);
+  uint64_t total = (uint64_t)1 << (2*order);
+  for (uint64_t d = 0; d < total; ++d) {
+    uint32_t tx, ty;
+    pixels__curve_decode(traversal, order, (uint32_t)d, &tx, &ty);
+    if ((int)tx < tiles_x && (int)ty < tiles_y) out[n++] = tx + ty*tiles_x;
+  }
+}
+
+static inline Pixels_Rgba pixels__raster_trilerp(const Pixels__Raster_Tri *rt, int x, int y) {
+  Pixels_Vector2f pt = { x, y };
+  Pixels_Vector2f ps[3] = { rt->p[0], rt->p[1], rt->p[2] };
+  Pixels_Rgba cs[3] = { rt->color[0], rt->color[1], rt->color[2] };
+  return pixels_barycentric_trilerp(ps, cs, pt);
+}
+
+static float pixels__srgb_to_linear_lut[256];
+static unsigned char pixels__linear_to_srgb_lut[PIXELS_LINEAR_LUT_SIZE];
+// Same entries before rounding, dithering needs the fraction that the byte table throws away
+static float pixels__linear_to_srgbf_lut[PIXELS_LINEAR_LUT_SIZE];
+
+static void pixels__build_srgb_luts(void) {
+  for (int i = 0; i < 256; ++i) {
+    double c = i / 255.0;
+    pixels__srgb_to_linear_lut[i] = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+  }
+  for (int i = 0; i < PIXELS_LINEAR_LUT_SIZE; ++i) {
+    double v = i / (double)(PIXELS_LINEAR_LUT_SIZE - 1);
+    double c = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+    pixels__linear_to_srgb_lut[i] = (unsigned char)floor(c * 255.0 + 0.5);
+    pixels__linear_to_srgbf_lut[i] = (float)(c * 255.0);
+  }
+}
+
+// Anything reading the sRGB tables calls this first, pthread_once makes late callers wait for the one building them
+#ifdef PIXELS_PTHREADS
+static pthread_once_t pixels__srgb_luts_once = PTHREAD_ONCE_INIT;
+static void pixels__init_srgb_luts(void) {
+  pthread_once(&pixels__srgb_luts_once, pixels__build_srgb_luts);
+}
+#else
+static bool pixels__srgb_luts_ready = false;
+static void pixels__init_srgb_luts(void) {
+  if (pixels__srgb_luts_ready) return;
+  pixels__build_srgb_luts();
+  pixels__srgb_luts_ready = true;
+}
+#endif // PIXELS_PTHREADS
+
+float pixels_srgb_to_linear(unsigned char c) {
+  pixels__init_srgb_luts();
+  return pixels__srgb_to_linear_lut[c];
+}
+
+static inline int pixels__linear_lut_index(float v) {
+  float t = v * (float)(PIXELS_LINEAR_LUT_SIZE - 1) + 0.5f;
+  return (int)PIXELS_CLAMP(t, 0.0f, (float)(PIXELS_LINEAR_LUT_SIZE - 1));
+}
+
+unsigned char pixels_linear_to_srgb(float v) {
+  pixels__init_srgb_luts();
+  return pixels__linear_to_srgb_lut[pixels__linear_lut_index(v)];
+}
+
+// Barycentric setup of pixels_barycentric_trilerp, done once per triangle with the vertex colors in linear light
+typedef struct {
+  float v0x, v0y, v1x, v1y, inv_den;
+  float lin[3][3];
+  float alpha[3];
+  bool degenerate;
+} Pixels__Linear_Shading;
+
+static void pixels__setup_linear_shading(Pixels__Linear_Shading *ls, const Pixels__Raster_Tri *rt) {
+  pixels__init_srgb_luts();
+  ls->v0x = rt->p[1].x - rt->p[0].x;
+  ls->v0y = rt->p[1].y - rt->p[0].y;
+  ls->v1x = rt->p[2].x - rt->p[0].x;
+  ls->v1y = rt->p[2].y - rt->p[0].y;
+  float den = ls->v0x * ls->v1y - ls->v1x * ls->v0y;
+  ls->degenerate = fabsf(den) < 1e-8f;
+  ls->inv_den = 1.0f / den;
+  for (int i = 0; i < 3; ++i) {
+    ls->lin[i][0] = pixels__srgb_to_linear_lut[rt->color[i].red];
+    ls->lin[i][1] = pixels__srgb_to_linear_lut[rt->color[i].green];
+    ls->lin[i][2] = pixels__srgb_to_linear_lut[rt->color[i].blue];
+    ls->alpha[i] = rt->color[i].alpha;
+  }
+}
+
+// Interpolates count pixels of row y starting at x in linear light and encodes them back to sRGB through the table
+static void pixels__shade_linear(Pixels_Rgba *out, size_t count, const Pixels__Linear_Shading *ls, const Pixels__Raster_Tri *rt, int x, int y) {
+  size_t i = 0;
+  if (ls->degenerate) {
+    // Nearest vertex color, no interpolation to correct
+    for (; i < count; ++i) out[i] = pixels__raster_trilerp(rt, x + i, y);
+    return;
+  }
+  float v2y = y - rt->p[0].y;
+#ifdef PIXELS_SSE2
+  const __m128 lut_max = _mm_set1_ps((float)(PIXELS_LINEAR_LUT_SIZE - 1));
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 inv_den = _mm_set1_ps(ls->inv_den);
+  for (; i + 4 <= count; i += 4) {
+    float xs = (float)(x + (int)i);
+    __m128 v2x = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(xs), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)), _mm_set1_ps(rt->p[0].x));
+    __m128 u = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(v2x, _mm_set1_ps(ls->v1y)), _mm_set1_ps(ls->v1x * v2y)), inv_den);
+    __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(ls->v0x * v2y), _mm_mul_ps(v2x, _mm_set1_ps(ls->v0y))), inv_den);
+    __m128 w = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), u), v);
+    int32_t idx[3][4];
+    for (int ch = 0; ch < 3; ++ch) {
+      __m128 lin = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(ls->lin[1][ch])), _mm_mul_ps(v, _mm_set1_ps(ls->lin[2][ch]))),
+                              _mm_mul_ps(w, _mm_set1_ps(ls->lin[0][ch])));
+      __m128 t = _mm_add_ps(_mm_mul_ps(lin, lut_max), half);
+      _mm_storeu_si128((__m128i*)idx[ch], _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(t, zero), lut_max)));
+    }
+    __m128 af = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(ls->alpha[1])), _mm_mul_ps(v, _mm_set1_ps(ls->alpha[2]))),
+                           _mm_mul_ps(w, _mm_set1_ps(ls->alpha[0])));
+    int32_t alpha[4];
+    _mm_storeu_si128((__m128i*)alpha, _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(af, half), zero), _mm_set1_ps(255.0f))));
+    for (int k = 0; k < 4; ++k) {
+      out[i + k].red   = pixels__linear_to_srgb_lut[idx[0][k]];
+      out[i + k].green = pixels__linear_to_srgb_lut[idx[1][k]];
+      out[i + k].blue  = pixels__linear_to_srgb_lut[idx[2][k]];
+      out[i + k].alpha = alpha[k];
+    }
+  }
+#endif // PIXELS_SSE2
+  for (; i < count; ++i) {
+    float v2x = (float)(x + (int)i) - rt->p[0].x;
+    float u = (v2x * ls->v1y - ls->v1x * v2y) * ls->inv_den;
+    float v = (ls->v0x * v2y - v2x * ls->v0y) * ls->inv_den;
+    float w = 1.0f - u - v;
+    float lin[3];
+    for (int ch = 0; ch < 3; ++ch) lin[ch] = u * ls->lin[1][ch] + v * ls->lin[2][ch] + w * ls->lin[0][ch];
+    float af = u * ls->alpha[1] + v * ls->alpha[2] + w * ls->alpha[0];
+    out[i].red   = pixels__linear_to_srgb_lut[pixels__linear_lut_index(lin[0])];
+    out[i].green = pixels__linear_to_srgb_lut[pixels__linear_lut_index(lin[1])];
+    out[i].blue  = pixels__linear_to_srgb_lut[pixels__linear_lut_index(lin[2])];
+    out[i].alpha = (unsigned char)PIXELS_CLAMP(af + 0.5f, 0.0f, 255.0f);
+  }
+}
+
+// Shades count pixels of row y starting at x, ls is only passed for linear light
+static void pixels__shade_span(Pixels_Rgba *span, size_t count, const Pixels__Raster_Tri *rt, const Pixels__Linear_Shading *ls, int x, int y) {
+  if (ls != NULL) {
+    pixels__shade_linear(span, count, ls, rt, x, y);
+  } else {
+    for (size_t i = 0; i < count; ++i) span[i] = pixels__raster_trilerp(rt, x + i, y);
+  }
+}
+
+void pixels_render_triangle(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Triangle tri) {
+  pixels_render_triangle_opt(cnv, camera, tri, (Pixels_Render_Opt) {0});
+}
+
+void pixels_render_triangle_opt(Pixels_Canvas *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt) {
+  Pixels__Raster_Tri rt;
+  if (!pixels__setup_triangle(&rt, cnv->width, cnv->height, cnv->origin_y, camera, tri)) return;
+
+  bool premultiply = false;
+  if (cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) {
+    premultiply = !pixels__blend_mode_is_premultiplied(opt.blend);
+    opt.blend = pixels__premultiplied_blend_mode(opt.blend);
+  }
+
+  Pixels__Linear_Shading ls;
+  if (opt.linear_light) pixels__setup_linear_shading(&ls, &rt);
+
+  // Plain replace shades straight onto the canvas, everything else is shaded into a span
+  // that gets converted and blended onto the row in one go
+  bool direct = opt.blend == PIXELS_BLEND_REPLACE && !premultiply && !opt.linear_light;
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgba fallback_span[64];
+  Pixels_Rgba *span = NULL;
+  size_t span_capacity = 0;
+  if (!direct) {
+    span_capacity = rt.x1 - rt.x0;
+    span = pixels_temp_alloc(sizeof(Pixels_Rgba)*span_capacity);
+    if (span == NULL) {
+      span = fallback_span;
+      span_capacity = PIXELS_ARRAY_LEN(fallback_span);
+    }
+  }
+
+  // Row traversal is a single tile covering the whole bounding box, curves walk tiles aligned to the canvas
+  int tile_shift = 0, order = 0;
+  uint32_t base_x = 0, base_y = 0, tiles_x = 1, tiles_y = 1;
+  if (opt.traversal != PIXELS_TRAVERSAL_ROWS) {
+    tile_shift = cnv->tile_shift != 0 ? cnv->tile_shift : pixels__curve_order(PIXELS_TRAVERSAL_TILE, 1);
+    base_x = (uint32_t)rt.x0 >> tile_shift;
+    base_y = (uint32_t)rt.y0 >> tile_shift;
+    tiles_x = (((uint32_t)rt.x1 - 1) >> tile_shift) - base_x + 1;
+    tiles_y = (((uint32_t)rt.y1 - 1) >> tile_shift) - base_y + 1;
+    order = pixels__curve_order(tiles_x, tiles_y);
+  }
+
+  uint64_t total = (uint64_t)1 << (2*order);
+  for (uint64_t d = 0; d < total; ++d) {
+    int tx0 = rt.x0, ty0 = rt.y0, tx1 = rt.x1, ty1 = rt.y1;
+    if (opt.traversal != PIXELS_TRAVERSAL_ROWS) {
+      uint32_t tx, ty;
+      pixels__curve_decode(opt.traversal, order, (uint32_t)d, &tx, &ty);
+      if (tx >= tiles_x || ty >= tiles_y) continue;
+      tx0 = PIXELS_MAX((int)((base_x + tx) << tile_shift), rt.x0);
+      ty0 = PIXELS_MAX((int)((base_y + ty) << tile_shift), rt.y0);
+      tx1 = PIXELS_MIN((int)((base_x + tx + 1) << tile_shift), rt.x1);
+      ty1 = PIXELS_MIN((int)((base_y + ty + 1) << tile_shift), rt.y1);
+    }
+
+    for (int y = ty0; y < ty1; ++y) {
+      int x = tx0, run_end;
+      while (pixels__raster_next_run_until(&rt, y, tx1, &x, &run_end)) {
+        // Runs get split wherever they cross into another tile
+        while (x < run_end) {
+          size_t count = pixels__contiguous_run(cnv, x, run_end);
+          Pixels_Rgba *dst = pixels_get_pixel(cnv, x, y - cnv->origin_y);
+          if (direct) {
+            for (size_t i = 0; i < count; ++i) dst[i] = pixels__raster_trilerp(&rt, x + i, y);
+          } else {
+            count = PIXELS_MIN(count, span_capacity);
+            pixels__shade_span(span, count, &rt, opt.linear_light ? &ls : NULL, x, y);
+            if (premultiply) pixels_premultiply_span(span, count);
+            pixels_blend_span(dst, span, count, opt.blend);
+          }
+          x += count;
+        }
       }
     }
   }
+
+  pixels_temp_rewind(checkpoint);
+}
+
+bool pixels_render_banded_opt(int width, int height, Pixels_Camera camera, Pixels_Scene_Fn scene, Pixels_Band_Sink_Fn sink, Pixels_Banded_Opt opt) {
+  int band_height = opt.band_height > 0 ? opt.band_height : PIXELS_BAND_HEIGHT;
+  band_height = PIXELS_MIN(band_height, height);
+  Pixels_Canvas band = pixels_create_canvas(width, band_height);
+  if (band.pixels == NULL) return false;
+  band.flags = opt.flags;
+
+  bool ok = true;
+  for (int y = 0; y < height && ok; y += band_height) {
+    // Last band can come up short, the canvas just pretends to be smaller
+    band.height = PIXELS_MIN(band_height, height - y);
+    band.count = (size_t)width*band.height;
+    // Opaque black reads the same premultiplied or not
+    pixels_canvas_fill(&band, (Pixels_Rgba) { 0, 0, 0, 255 }, 1);
+
+    band.origin_y = y;
+    scene(&band, camera, opt.scene_user);
+    ok = sink(&band, y, opt.sink_user);
+  }
+
+  band.count = (size_t)width*band_height;
+  pixels_destroy_canvas(&band);
+  return ok;
 }
 
 
@@ -438,7 +2375,8 @@ Pixels_Hsla pixels_rgb2hsl(Pixels_Rgba rgb) {
   } else if (max_val == b) {
     out.hue = (r - g) / d + 4;
   }
-  
+  out.hue /= 6;
+
   return out;
 }
 
@@ -460,7 +2398,7 @@ float pixels_hue2rgb(float p, float q, float t) {
 Pixels_Rgba pixels_hsl2rgb(Pixels_Hsla hsl) {
   Pixels_Rgba out = { .alpha = (unsigned char)floorf(hsl.alpha * 255) };
   if (hsl.saturation == 0) {
-    out.red = out.green = out.blue = hsl.lightness; // Achromatic
+    out.red = out.green = out.blue = roundf(hsl.lightness * 255); // Achromatic
     return out;
   }
 
@@ -472,34 +2410,3318 @@ Pixels_Rgba pixels_hsl2rgb(Pixels_Hsla hsl) {
   float p = 2 * l - q;
   out.red = roundf(pixels_hue2rgb(p, q, h + 1.0/3) * 255);
   out.green = roundf(pixels_hue2rgb(p, q, h) * 255);
-  out.red = roundf(pixels_hue2rgb(p, q, h - 1.0/3) * 255);
+  out.blue = roundf(pixels_hue2rgb(p, q, h - 1.0/3) * 255);
 
   return out;
 }
-#endif // PIXELS_IMPLEMENTATION
 
-#ifndef PIXELS_STRIP_GUARD_H_
-  #ifdef PIXELS_STRIP_PREFIX
-    #define Rgba Pixels_Rgba
-    #define RGBa Pixels_RGBa
-    #define RGB Pixels_RGB
-    #define RGB_Fmt Pixels_RGB_Fmt
-    #define RGB_Arg Pixels_RGB_Arg
-    #define RGBa_Fmt Pixels_RGBa_Fmt
-    #define RGBa_Arg Pixels_RGBa_Arg
-    #define RED Pixels_RED
-    #define GREEN Pixels_GREEN
-    #define BLUE Pixels_BLUE
+Pixels_Hsla_Planes pixels_temp_hsla_planes(size_t count) {
+  Pixels_Hsla_Planes planes = {0};
+  size_t checkpoint = pixels_temp_save();
+  planes.hue = pixels_temp_alloc(sizeof(float)*count);
+  planes.saturation = pixels_temp_alloc(sizeof(float)*count);
+  planes.lightness = pixels_temp_alloc(sizeof(float)*count);
+  planes.alpha = pixels_temp_alloc(sizeof(float)*count);
+  if (!planes.hue || !planes.saturation || !planes.lightness || !planes.alpha) {
+    pixels_temp_rewind(checkpoint);
+    memset(&planes, 0, sizeof(planes));
+  }
+  return planes;
+}
 
-    #define Hsla Pixels_Hsla
-    #define HSLa Pixels_HSLa
-    #define HSL Pixels_HSL
-    #define HSL_Fmt Pixels_HSL_Fmt
-    #define HSL_Arg Pixels_HSL_Arg
-    #define HSLa_Fmt Pixels_HSLa_Fmt
-    #define HSLa_Arg Pixels_HSLa_Arg
-    #define rgb2hsl pixels_rgb2hsl
-    #define hsl2rgb pixels_hsl2rgb
+#ifdef PIXELS_SSE2
+static inline __m128 pixels__sse2_select(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Same steps as pixels_rgb2hsl but every branch is computed and picked with masks
+static inline void pixels__sse2_rgb2hsl_4px(__m128i px, __m128 *h, __m128 *s, __m128 *l, __m128 *a) {
+  const __m128i byte_mask = _mm_set1_epi32(0xFF);
+  __m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(px, byte_mask)), _mm_set1_ps(255.0f));
+  __m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byte_mask)), _mm_set1_ps(255.0f));
+  __m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byte_mask)), _mm_set1_ps(255.0f));
+  *a = _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(px, 24)), _mm_set1_ps(255.0f));
+
+  __m128 max_val = _mm_max_ps(_mm_max_ps(r, g), b);
+  __m128 min_val = _mm_min_ps(_mm_min_ps(r, g), b);
+  __m128 sum = _mm_add_ps(max_val, min_val);
+  __m128 d = _mm_sub_ps(max_val, min_val);
+  __m128 achromatic = _mm_cmpeq_ps(max_val, min_val);
+  // Keep the divisions finite for achromatic lanes, they get zeroed out at the end anyway
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 safe_d = pixels__sse2_select(achromatic, one, d);
+
+  *l = _mm_mul_ps(sum, _mm_set1_ps(0.5f));
+  __m128 s_den = pixels__sse2_select(_mm_cmpgt_ps(*l, _mm_set1_ps(0.5f)), _mm_sub_ps(_mm_set1_ps(2.0f), sum), sum);
+  s_den = pixels__sse2_select(achromatic, one, s_den);
+  *s = _mm_andnot_ps(achromatic, _mm_div_ps(d, s_den));
+
+  __m128 hr = _mm_add_ps(_mm_div_ps(_mm_sub_ps(g, b), safe_d), _mm_and_ps(_mm_cmplt_ps(g, b), _mm_set1_ps(6.0f)));
+  __m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), safe_d), _mm_set1_ps(2.0f));
+  __m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), safe_d), _mm_set1_ps(4.0f));
+  __m128 hue = pixels__sse2_select(_mm_cmpeq_ps(max_val, g), hg, hb);
+  hue = pixels__sse2_select(_mm_cmpeq_ps(max_val, r), hr, hue);
+  *h = _mm_andnot_ps(achromatic, _mm_div_ps(hue, _mm_set1_ps(6.0f)));
+}
+
+static inline __m128 pixels__sse2_hue2rgb(__m128 p, __m128 q, __m128 t) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 six = _mm_set1_ps(6.0f);
+  t = _mm_add_ps(t, _mm_and_ps(_mm_cmplt_ps(t, zero), one));
+  t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, one), one));
+  __m128 q_p = _mm_sub_ps(q, p);
+  __m128 rising = _mm_add_ps(p, _mm_mul_ps(_mm_mul_ps(q_p, six), t));
+  __m128 falling = _mm_add_ps(p, _mm_mul_ps(_mm_mul_ps(q_p, _mm_sub_ps(_mm_set1_ps(2.0f/3.0f), t)), six));
+  __m128 out = pixels__sse2_select(_mm_cmplt_ps(t, _mm_set1_ps(2.0f/3.0f)), falling, p);
+  out = pixels__sse2_select(_mm_cmplt_ps(t, _mm_set1_ps(0.5f)), q, out);
+  return pixels__sse2_select(_mm_cmplt_ps(t, _mm_set1_ps(1.0f/6.0f)), rising, out);
+}
+
+static inline __m128i pixels__sse2_unit_to_byte(__m128 v) {
+  v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+  return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+}
+
+// Achromatic pixels don't need their own path, with s == 0 both p and q end up being l
+static inline __m128i pixels__sse2_hsl2rgb_4px(__m128 h, __m128 s, __m128 l, __m128 a) {
+  __m128 q = pixels__sse2_select(_mm_cmplt_ps(l, _mm_set1_ps(0.5f)),
+                                 _mm_mul_ps(l, _mm_add_ps(_mm_set1_ps(1.0f), s)),
+                                 _mm_sub_ps(_mm_add_ps(l, s), _mm_mul_ps(l, s)));
+  __m128 p = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), l), q);
+  __m128 third = _mm_set1_ps(1.0f/3.0f);
+  __m128i r = pixels__sse2_unit_to_byte(pixels__sse2_hue2rgb(p, q, _mm_add_ps(h, third)));
+  __m128i g = pixels__sse2_unit_to_byte(pixels__sse2_hue2rgb(p, q, h));
+  __m128i b = pixels__sse2_unit_to_byte(pixels__sse2_hue2rgb(p, q, _mm_sub_ps(h, third)));
+  __m128 alpha = _mm_min_ps(_mm_max_ps(_mm_mul_ps(a, _mm_set1_ps(255.0f)), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+  __m128i alpha_byte = _mm_cvttps_epi32(alpha);
+  return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(alpha_byte, 24)));
+}
+#endif // PIXELS_SSE2
+
+void pixels_rgb2hsl_span(const Pixels_Rgba *src, size_t count, Pixels_Hsla_Planes out) {
+  size_t i = 0;
+#ifdef PIXELS_SSE2
+  for (; i + 4 <= count; i += 4) {
+    __m128 h, s, l, a;
+    pixels__sse2_rgb2hsl_4px(_mm_loadu_si128((const __m128i*)(src + i)), &h, &s, &l, &a);
+    _mm_storeu_ps(out.hue + i, h);
+    _mm_storeu_ps(out.saturation + i, s);
+    _mm_storeu_ps(out.lightness + i, l);
+    _mm_storeu_ps(out.alpha + i, a);
+  }
+#endif // PIXELS_SSE2
+  for (; i < count; ++i) {
+    Pixels_Hsla hsl = pixels_rgb2hsl(src[i]);
+    out.hue[i] = hsl.hue;
+    out.saturation[i] = hsl.saturation;
+    out.lightness[i] = hsl.lightness;
+    out.alpha[i] = hsl.alpha;
+  }
+}
+
+void pixels_hsl2rgb_span(Pixels_Hsla_Planes in, size_t count, Pixels_Rgba *dst) {
+  size_t i = 0;
+#ifdef PIXELS_SSE2
+  for (; i + 4 <= count; i += 4) {
+    __m128i px = pixels__sse2_hsl2rgb_4px(_mm_loadu_ps(in.hue + i), _mm_loadu_ps(in.saturation + i),
+                                          _mm_loadu_ps(in.lightness + i), _mm_loadu_ps(in.alpha + i));
+    _mm_storeu_si128((__m128i*)(dst + i), px);
+  }
+#endif // PIXELS_SSE2
+  for (; i < count; ++i) {
+    Pixels_Hsla hsl = { in.hue[i], in.saturation[i], in.lightness[i], in.alpha[i] };
+    dst[i] = pixels_hsl2rgb(hsl);
+  }
+}
+
+void pixels_canvas_rgb2hsl(const Pixels_Canvas *cnv, Pixels_Hsla_Planes out) {
+  pixels_rgb2hsl_span(cnv->pixels, cnv->count, out);
+}
+
+void pixels_canvas_hsl2rgb(Pixels_Canvas *cnv, Pixels_Hsla_Planes in) {
+  pixels_hsl2rgb_span(in, cnv->count, cnv->pixels);
+}
+
+bool pixels_build_hsl_lut(Pixels_Hsl_Lut *lut, Pixels_Rgba *entries, float dh, float ds, float dl) {
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Hsla_Planes planes = pixels_temp_hsla_planes(PIXELS_HSL_LUT_COUNT);
+  if (planes.hue == NULL) return false;
+
+  size_t i = 0;
+  for (int b = 0; b < PIXELS_HSL_LUT_SIZE; ++b) {
+    for (int g = 0; g < PIXELS_HSL_LUT_SIZE; ++g) {
+      for (int r = 0; r < PIXELS_HSL_LUT_SIZE; ++r, ++i) {
+        entries[i].red   = (r*255 + (PIXELS_HSL_LUT_SIZE - 1)/2) / (PIXELS_HSL_LUT_SIZE - 1);
+        entries[i].green = (g*255 + (PIXELS_HSL_LUT_SIZE - 1)/2) / (PIXELS_HSL_LUT_SIZE - 1);
+        entries[i].blue  = (b*255 + (PIXELS_HSL_LUT_SIZE - 1)/2) / (PIXELS_HSL_LUT_SIZE - 1);
+        entries[i].alpha = 255;
+      }
+    }
+  }
+
+  pixels_rgb2hsl_span(entries, PIXELS_HSL_LUT_COUNT, planes);
+  for (i = 0; i < PIXELS_HSL_LUT_COUNT; ++i) {
+    float hue = planes.hue[i] + dh;
+    planes.hue[i] = hue - floorf(hue);
+    planes.saturation[i] = PIXELS_CLAMP(planes.saturation[i] + ds, 0.0f, 1.0f);
+    planes.lightness[i] = PIXELS_CLAMP(planes.lightness[i] + dl, 0.0f, 1.0f);
+  }
+  pixels_hsl2rgb_span(planes, PIXELS_HSL_LUT_COUNT, entries);
+  pixels_temp_rewind(checkpoint);
+
+  lut->dh = dh;
+  lut->ds = ds;
+  lut->dl = dl;
+  lut->entries = entries;
+  return true;
+}
+
+// Node index and 1.7 fixed point fraction of a channel value, the last cell gets a fraction of 1 so index+1 stays in the table
+static void pixels__hsl_lut_axis(unsigned short index[256], unsigned short frac[256]) {
+  for (int c = 0; c < 256; ++c) {
+    int pos = (c*(PIXELS_HSL_LUT_SIZE - 1)*128 + 127) / 255;
+    int idx = pos >> 7;
+    int f = pos & 127;
+    if (idx == PIXELS_HSL_LUT_SIZE - 1) {
+      idx -= 1;
+      f = 128;
+    }
+    index[c] = idx;
+    frac[c] = f;
+  }
+}
+
+#define PIXELS__LUT_LERP(a, b, f) ((a) + ((((b) - (a))*(f) + 64) >> 7))
+
+#ifdef PIXELS_SSE2
+static inline __m128i pixels__sse2_lut_lerp(__m128i a, __m128i b, int f) {
+  __m128i diff = _mm_mullo_epi16(_mm_sub_epi16(b, a), _mm_set1_epi16(f));
+  return _mm_add_epi16(a, _mm_srai_epi16(_mm_add_epi16(diff, _mm_set1_epi16(64)), 7));
+}
+#endif // PIXELS_SSE2
+
+static void pixels__apply_hsl_lut_span(Pixels_Rgba *pixels, size_t count, const Pixels_Hsl_Lut *lut,
+                                       const unsigned short index[256], const unsigned short frac[256]) {
+  const size_t S = PIXELS_HSL_LUT_SIZE;
+  const Pixels_Rgba *e = lut->entries;
+  for (Pixels_Rgba *it = pixels; it < pixels + count; ++it) {
+    Pixels_Rgba px = *it;
+    size_t base = (index[px.blue]*S + index[px.green])*S + index[px.red];
+    int fr = frac[px.red], fg = frac[px.green], fb = frac[px.blue];
+#ifdef PIXELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    // Each load grabs the red pair of one (green, blue) corner
+    __m128i g0b0 = _mm_loadl_epi64((const __m128i*)(e + base));
+    __m128i g1b0 = _mm_loadl_epi64((const __m128i*)(e + base + S));
+    __m128i g0b1 = _mm_loadl_epi64((const __m128i*)(e + base + S*S));
+    __m128i g1b1 = _mm_loadl_epi64((const __m128i*)(e + base + S*S + S));
+    // [r0 g0, r0 g1, r1 g0, r1 g1] so red interpolates between the low and high halves
+    __m128i b0 = _mm_unpacklo_epi32(g0b0, g1b0);
+    __m128i b1 = _mm_unpacklo_epi32(g0b1, g1b1);
+    b0 = pixels__sse2_lut_lerp(_mm_unpacklo_epi8(b0, zero), _mm_unpackhi_epi8(b0, zero), fr);
+    b1 = pixels__sse2_lut_lerp(_mm_unpacklo_epi8(b1, zero), _mm_unpackhi_epi8(b1, zero), fr);
+    // [g0 b0, g0 b1] against [g1 b0, g1 b1]
+    __m128i v = pixels__sse2_lut_lerp(_mm_unpacklo_epi64(b0, b1), _mm_unpackhi_epi64(b0, b1), fg);
+    v = pixels__sse2_lut_lerp(v, _mm_srli_si128(v, 8), fb);
+    uint32_t out = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+    memcpy(it, &out, sizeof(out));
+#else
+    Pixels_Rgba c[8] = {
+      e[base], e[base + 1], e[base + S], e[base + S + 1],
+      e[base + S*S], e[base + S*S + 1], e[base + S*S + S], e[base + S*S + S + 1],
+    };
+    unsigned char *out = (unsigned char*)it;
+    for (int ch = 0; ch < 3; ++ch) {
+      int c000 = ((unsigned char*)&c[0])[ch], c100 = ((unsigned char*)&c[1])[ch];
+      int c010 = ((unsigned char*)&c[2])[ch], c110 = ((unsigned char*)&c[3])[ch];
+      int c001 = ((unsigned char*)&c[4])[ch], c101 = ((unsigned char*)&c[5])[ch];
+      int c011 = ((unsigned char*)&c[6])[ch], c111 = ((unsigned char*)&c[7])[ch];
+      int g0b0 = PIXELS__LUT_LERP(c000, c100, fr), g1b0 = PIXELS__LUT_LERP(c010, c110, fr);
+      int g0b1 = PIXELS__LUT_LERP(c001, c101, fr), g1b1 = PIXELS__LUT_LERP(c011, c111, fr);
+      int b0 = PIXELS__LUT_LERP(g0b0, g1b0, fg), b1 = PIXELS__LUT_LERP(g0b1, g1b1, fg);
+      out[ch] = PIXELS__LUT_LERP(b0, b1, fb);
+    }
+#endif // PIXELS_SSE2
+    it->alpha = px.alpha;
+  }
+}
+
+void pixels_canvas_apply_hsl_lut(Pixels_Canvas *cnv, const Pixels_Hsl_Lut *lut) {
+  unsigned short index[256], frac[256];
+  pixels__hsl_lut_axis(index, frac);
+  if (!(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED)) {
+    pixels__apply_hsl_lut_span(cnv->pixels, cnv->count, lut, index, frac);
+    return;
+  }
+  // Table is indexed by straight colors, chunks get unpremultiplied and premultiplied back while still in cache
+  for (size_t i = 0; i < cnv->count; i += 256) {
+    size_t n = PIXELS_MIN(cnv->count - i, (size_t)256);
+    pixels_unpremultiply_span(cnv->pixels + i, cnv->pixels + i, n);
+    pixels__apply_hsl_lut_span(cnv->pixels + i, n, lut, index, frac);
+    pixels_premultiply_span(cnv->pixels + i, n);
+  }
+}
+
+static PIXELS_THREAD_LOCAL Pixels_Hsl_Lut pixels__hsl_lut_cache = {0};
+
+#ifdef PIXELS_PTHREADS
+// Holds the cached entries so they get freed on thread exit, like pixels__temp_arena_key does for the arena
+static pthread_key_t pixels__hsl_lut_key;
+static pthread_once_t pixels__hsl_lut_key_once = PTHREAD_ONCE_INIT;
+
+static void pixels__free_hsl_lut_entries(void *entries) {
+  PIXELS_FREE(entries);
+}
+
+static void pixels__create_hsl_lut_key(void) {
+  pthread_key_create(&pixels__hsl_lut_key, pixels__free_hsl_lut_entries);
+}
+#endif // PIXELS_PTHREADS
+
+void pixels_release_hsl_lut_cache(void) {
+#ifdef PIXELS_PTHREADS
+  if (pixels__hsl_lut_cache.entries != NULL) pthread_setspecific(pixels__hsl_lut_key, NULL);
+#endif // PIXELS_PTHREADS
+  PIXELS_FREE(pixels__hsl_lut_cache.entries);
+  pixels__hsl_lut_cache = (Pixels_Hsl_Lut) {0};
+}
+
+bool pixels_canvas_adjust_hsl(Pixels_Canvas *cnv, float dh, float ds, float dl) {
+  Pixels_Hsl_Lut *lut = &pixels__hsl_lut_cache;
+  if (lut->entries == NULL || lut->dh != dh || lut->ds != ds || lut->dl != dl) {
+    Pixels_Rgba *entries = lut->entries;
+    if (entries == NULL) {
+      entries = PIXELS_MALLOC(sizeof(Pixels_Rgba)*PIXELS_HSL_LUT_COUNT);
+      if (entries == NULL) return false;
+#ifdef PIXELS_PTHREADS
+      pthread_once(&pixels__hsl_lut_key_once, pixels__create_hsl_lut_key);
+      pthread_setspecific(pixels__hsl_lut_key, entries);
+#endif // PIXELS_PTHREADS
+    }
+    if (!pixels_build_hsl_lut(lut, entries, dh, ds, dl)) {
+      // Keep the table around but make sure it's not mistaken for a valid one
+      lut->entries = entries;
+      lut->dh = NAN;
+      return false;
+    }
+  }
+  pixels_canvas_apply_hsl_lut(cnv, lut);
+  return true;
+}
+
+
+// Bit twiddling conversions, rounding to nearest even like the F16C instructions do
+uint16_t pixels_float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs_x = x & 0x7FFFFFFF;
+  if (abs_x >= 0x7F800000) {
+    // Inf stays inf, NaN stays a quiet NaN
+    return sign | 0x7C00 | (abs_x > 0x7F800000 ? 0x200 : 0);
+  }
+  if (abs_x >= 0x477FF000) return sign | 0x7C00; // Rounds past the largest half
+  if (abs_x < 0x38800000) {
+    // Subnormal half, or zero
+    if (abs_x < 0x33000000) return sign;
+    uint32_t e = abs_x >> 23;
+    uint32_t m = (abs_x & 0x7FFFFF) | 0x800000;
+    uint32_t shift = 126 - e;
+    uint32_t h = m >> shift;
+    uint32_t rem = m & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rem > halfway || (rem == halfway && (h & 1))) h += 1;
+    return sign | h;
+  }
+  uint32_t h = ((abs_x - 0x38000000) >> 13);
+  uint32_t rem = abs_x & 0x1FFF;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h += 1;
+  return sign | h;
+}
+
+float pixels_half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t e = (h >> 10) & 0x1F;
+  uint32_t m = h & 0x3FF;
+  uint32_t x;
+  if (e == 0x1F) {
+    x = sign | 0x7F800000 | (m << 13);
+  } else if (e != 0) {
+    x = sign | ((e + 112) << 23) | (m << 13);
+  } else if (m == 0) {
+    x = sign;
+  } else {
+    // Normalize the subnormal
+    e = 113;
+    while (!(m & 0x400)) {
+      m <<= 1;
+      e -= 1;
+    }
+    x = sign | (e << 23) | ((m & 0x3FF) << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static void pixels__half_to_rgbaf(Pixels_Rgbaf *dst, const Pixels_Rgbah *src, size_t count) {
+  size_t i = 0;
+#ifdef PIXELS_F16C
+  for (; i < count; ++i) _mm_storeu_ps(&dst[i].red, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i))));
+#endif // PIXELS_F16C
+  for (; i < count; ++i) {
+    dst[i].red   = pixels_half_to_float(src[i].red);
+    dst[i].green = pixels_half_to_float(src[i].green);
+    dst[i].blue  = pixels_half_to_float(src[i].blue);
+    dst[i].alpha = pixels_half_to_float(src[i].alpha);
+  }
+}
+
+static void pixels__rgbaf_to_half(Pixels_Rgbah *dst, const Pixels_Rgbaf *src, size_t count) {
+  size_t i = 0;
+#ifdef PIXELS_F16C
+  for (; i < count; ++i) {
+    _mm_storel_epi64((__m128i*)(dst + i), _mm_cvtps_ph(_mm_loadu_ps(&src[i].red), _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif // PIXELS_F16C
+  for (; i < count; ++i) {
+    dst[i].red   = pixels_float_to_half(src[i].red);
+    dst[i].green = pixels_float_to_half(src[i].green);
+    dst[i].blue  = pixels_float_to_half(src[i].blue);
+    dst[i].alpha = pixels_float_to_half(src[i].alpha);
+  }
+}
+
+static Pixels_CanvasF pixels__create_canvasf(int width, int height, bool half) {
+  Pixels_CanvasF cnv = {0};
+  size_t count;
+  size_t pixel_size = half ? sizeof(Pixels_Rgbah) : sizeof(Pixels_Rgbaf);
+  if (!pixels__canvas_count(width, height, PIXELS_LAYOUT_LINEAR, pixel_size, 0, &count)) return cnv;
+  if (half) {
+    cnv.half_pixels = PIXELS_MALLOC(sizeof(Pixels_Rgbah)*count);
+    if (cnv.half_pixels == NULL) return cnv;
+    Pixels_Rgbah black = { 0, 0, 0, pixels_float_to_half(1.0f) };
+    for (size_t i = 0; i < count; ++i) cnv.half_pixels[i] = black;
+  } else {
+    cnv.pixels = PIXELS_MALLOC(sizeof(Pixels_Rgbaf)*count);
+    if (cnv.pixels == NULL) return cnv;
+    Pixels_Rgbaf black = { 0, 0, 0, 1.0f };
+    for (size_t i = 0; i < count; ++i) cnv.pixels[i] = black;
+  }
+  cnv.width = width;
+  cnv.height = height;
+  cnv.count = count;
+  return cnv;
+}
+
+Pixels_CanvasF pixels_create_canvasf(int width, int height) {
+  return pixels__create_canvasf(width, height, false);
+}
+
+Pixels_CanvasF pixels_create_canvasf_half(int width, int height) {
+  return pixels__create_canvasf(width, height, true);
+}
+
+void pixels_destroy_canvasf(Pixels_CanvasF *cnv) {
+  PIXELS_FREE(cnv->pixels);
+  PIXELS_FREE(cnv->half_pixels);
+  cnv->pixels = NULL;
+  cnv->half_pixels = NULL;
+  cnv->count = 0;
+}
+
+// Same interpolation as pixels__shade_linear but kept as linear floats, one pixel per SIMD register
+static void pixels__shade_linear_f(Pixels_Rgbaf *out, size_t count, const Pixels__Linear_Shading *ls, const Pixels__Raster_Tri *rt, int x, int y) {
+  if (ls->degenerate) {
+    for (size_t i = 0; i < count; ++i) {
+      Pixels_Rgba c = pixels__raster_trilerp(rt, x + i, y);
+      out[i].red   = pixels__srgb_to_linear_lut[c.red];
+      out[i].green = pixels__srgb_to_linear_lut[c.green];
+      out[i].blue  = pixels__srgb_to_linear_lut[c.blue];
+      out[i].alpha = c.alpha / 255.0f;
+    }
+    return;
+  }
+  float v2y = y - rt->p[0].y;
+#ifdef PIXELS_SSE2
+  __m128 c0 = _mm_setr_ps(ls->lin[0][0], ls->lin[0][1], ls->lin[0][2], ls->alpha[0] / 255.0f);
+  __m128 c1 = _mm_setr_ps(ls->lin[1][0], ls->lin[1][1], ls->lin[1][2], ls->alpha[1] / 255.0f);
+  __m128 c2 = _mm_setr_ps(ls->lin[2][0], ls->lin[2][1], ls->lin[2][2], ls->alpha[2] / 255.0f);
+#endif // PIXELS_SSE2
+  for (size_t i = 0; i < count; ++i) {
+    float v2x = (float)(x + (int)i) - rt->p[0].x;
+    float u = (v2x * ls->v1y - ls->v1x * v2y) * ls->inv_den;
+    float v = (ls->v0x * v2y - v2x * ls->v0y) * ls->inv_den;
+    float w = 1.0f - u - v;
+#ifdef PIXELS_SSE2
+    __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(u), c1), _mm_mul_ps(_mm_set1_ps(v), c2)), _mm_mul_ps(_mm_set1_ps(w), c0));
+    _mm_storeu_ps(&out[i].red, _mm_max_ps(c, _mm_setzero_ps()));
+#else
+    out[i].red   = PIXELS_MAX(u * ls->lin[1][0] + v * ls->lin[2][0] + w * ls->lin[0][0], 0.0f);
+    out[i].green = PIXELS_MAX(u * ls->lin[1][1] + v * ls->lin[2][1] + w * ls->lin[0][1], 0.0f);
+    out[i].blue  = PIXELS_MAX(u * ls->lin[1][2] + v * ls->lin[2][2] + w * ls->lin[0][2], 0.0f);
+    out[i].alpha = PIXELS_MAX(u * ls->alpha[1] / 255.0f + v * ls->alpha[2] / 255.0f + w * ls->alpha[0] / 255.0f, 0.0f);
+#endif // PIXELS_SSE2
+  }
+}
+
+// Float version of pixels_blend_span, nothing is clamped except alpha
+static void pixels__blend_span_f(Pixels_Rgbaf *dst, const Pixels_Rgbaf *src, size_t count, Pixels_Blend_Mode mode) {
+  if (mode == PIXELS_BLEND_REPLACE) {
+    memcpy(dst, src, sizeof(Pixels_Rgbaf)*count);
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (mode == PIXELS_BLEND_SRC_OVER && dst[i].alpha < 1.0f) {
+      // Same split as the integer version, translucent destinations divide by the alpha they end up with
+      Pixels_Rgbaf s = src[i], d = dst[i];
+      float dw = d.alpha * (1.0f - s.alpha);
+      float a = s.alpha + dw;
+      float inv = a > 0.0f ? 1.0f / a : 0.0f;
+      dst[i].red   = (s.red * s.alpha + d.red * dw) * inv;
+      dst[i].green = (s.green * s.alpha + d.green * dw) * inv;
+      dst[i].blue  = (s.blue * s.alpha + d.blue * dw) * inv;
+      dst[i].alpha = PIXELS_MIN(a, 1.0f);
+      continue;
+    }
+#ifdef PIXELS_SSE2
+    __m128 s = _mm_loadu_ps(&src[i].red);
+    __m128 d = _mm_loadu_ps(&dst[i].red);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 ia = _mm_sub_ps(one, sa);
+    // Source alpha for the color channels and 1 for alpha itself, same trick as the integer kernel
+    __m128 sa_color = _mm_shuffle_ps(sa, _mm_unpacklo_ps(sa, one), _MM_SHUFFLE(1, 0, 0, 0));
+    __m128 out;
+    switch (mode) {
+    case PIXELS_BLEND_SRC_OVER:        out = _mm_add_ps(_mm_mul_ps(s, sa_color), _mm_mul_ps(d, ia)); break;
+    case PIXELS_BLEND_SRC_OVER_PREMUL: out = _mm_add_ps(s, _mm_mul_ps(d, ia)); break;
+    case PIXELS_BLEND_ADD:             out = _mm_add_ps(d, _mm_mul_ps(s, sa_color)); break;
+    case PIXELS_BLEND_ADD_PREMUL:      out = _mm_add_ps(d, s); break;
+    case PIXELS_BLEND_MULTIPLY:        out = _mm_mul_ps(d, _mm_add_ps(_mm_mul_ps(s, sa), ia)); break;
+    case PIXELS_BLEND_MULTIPLY_PREMUL: out = _mm_mul_ps(d, _mm_add_ps(s, ia)); break;
+    default:                           out = s; break;
+    }
+    _mm_storeu_ps(&dst[i].red, out);
+    float a = dst[i].alpha;
+    if (mode == PIXELS_BLEND_MULTIPLY || mode == PIXELS_BLEND_MULTIPLY_PREMUL) {
+      a = src[i].alpha + _mm_cvtss_f32(_mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 3, 3))) * (1.0f - src[i].alpha);
+    }
+#else
+    Pixels_Rgbaf s = src[i], d = dst[i];
+    float sa = s.alpha, ia = 1.0f - sa;
+    float a = sa + d.alpha * ia;
+    switch (mode) {
+    case PIXELS_BLEND_SRC_OVER:
+      dst[i].red   = s.red * sa + d.red * ia;
+      dst[i].green = s.green * sa + d.green * ia;
+      dst[i].blue  = s.blue * sa + d.blue * ia;
+      break;
+    case PIXELS_BLEND_SRC_OVER_PREMUL:
+      dst[i].red   = s.red + d.red * ia;
+      dst[i].green = s.green + d.green * ia;
+      dst[i].blue  = s.blue + d.blue * ia;
+      break;
+    case PIXELS_BLEND_ADD:
+      dst[i].red   = d.red + s.red * sa;
+      dst[i].green = d.green + s.green * sa;
+      dst[i].blue  = d.blue + s.blue * sa;
+      a = d.alpha + sa;
+      break;
+    case PIXELS_BLEND_ADD_PREMUL:
+      dst[i].red   = d.red + s.red;
+      dst[i].green = d.green + s.green;
+      dst[i].blue  = d.blue + s.blue;
+      a = d.alpha + sa;
+      break;
+    case PIXELS_BLEND_MULTIPLY:
+      dst[i].red   = d.red * (s.red * sa + ia);
+      dst[i].green = d.green * (s.green * sa + ia);
+      dst[i].blue  = d.blue * (s.blue * sa + ia);
+      break;
+    case PIXELS_BLEND_MULTIPLY_PREMUL:
+      dst[i].red   = d.red * (s.red + ia);
+      dst[i].green = d.green * (s.green + ia);
+      dst[i].blue  = d.blue * (s.blue + ia);
+      break;
+    default:
+      dst[i] = s;
+      a = sa;
+      break;
+    }
+#endif // PIXELS_SSE2
+    dst[i].alpha = PIXELS_MIN(a, 1.0f);
+  }
+}
+
+void pixels_render_trianglef(Pixels_CanvasF *cnv, Pixels_Camera camera, Pixels_Triangle tri) {
+  pixels_render_trianglef_opt(cnv, camera, tri, (Pixels_Render_Opt) {0});
+}
+
+void pixels_render_trianglef_opt(Pixels_CanvasF *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt) {
+  Pixels__Raster_Tri rt;
+  if (!pixels__setup_triangle(&rt, cnv->width, cnv->height, 0, camera, tri)) return;
+
+  Pixels__Linear_Shading ls;
+  pixels__setup_linear_shading(&ls, &rt);
+
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgbaf fallback_span[32], fallback_row[32];
+  size_t span_capacity = rt.x1 - rt.x0;
+  Pixels_Rgbaf *span = pixels_temp_alloc(sizeof(Pixels_Rgbaf)*span_capacity);
+  // Half canvases get widened into a float row, blended and narrowed back
+  Pixels_Rgbaf *row_f = NULL;
+  if (cnv->half_pixels != NULL) row_f = pixels_temp_alloc(sizeof(Pixels_Rgbaf)*span_capacity);
+  if (span == NULL || (cnv->half_pixels != NULL && row_f == NULL)) {
+    span = fallback_span;
+    row_f = fallback_row;
+    span_capacity = PIXELS_ARRAY_LEN(fallback_span);
+  }
+
+  for (int y = rt.y0; y < rt.y1; ++y) {
+    int x = rt.x0, run_end;
+    while (pixels__raster_next_run(&rt, y, &x, &run_end)) {
+      while (x < run_end) {
+        size_t count = PIXELS_MIN((size_t)(run_end - x), span_capacity);
+        size_t at = (size_t)y*cnv->width + x;
+        pixels__shade_linear_f(span, count, &ls, &rt, x, y);
+        if (cnv->half_pixels != NULL) {
+          pixels__half_to_rgbaf(row_f, cnv->half_pixels + at, count);
+          pixels__blend_span_f(row_f, span, count, opt.blend);
+          pixels__rgbaf_to_half(cnv->half_pixels + at, row_f, count);
+        } else {
+          pixels__blend_span_f(cnv->pixels + at, span, count, opt.blend);
+        }
+        x += count;
+      }
+    }
+  }
+
+  pixels_temp_rewind(checkpoint);
+}
+
+#ifndef PIXELS_SSE2
+static float pixels__tonemap_channel(Pixels_Tonemap_Operator op, float c) {
+  switch (op) {
+  case PIXELS_TONEMAP_REINHARD:
+    return c / (1.0f + c);
+  case PIXELS_TONEMAP_ACES:
+    return (c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f);
+  default:
+    return c;
+  }
+}
+#endif // PIXELS_SSE2
+
+bool pixels_canvasf_tonemap_opt(const Pixels_CanvasF *src, Pixels_Canvas *dst, Pixels_Tonemap_Opt opt) {
+  if (src->width != dst->width || src->height != dst->height) return false;
+  pixels__init_srgb_luts();
+  const float *srgbf = pixels__linear_to_srgbf_lut;
+
+  // Thresholds in [-0.5, 0.5) of an output step
+  static const float bayer[4][4] = {
+    { -0.46875f,  0.03125f, -0.34375f,  0.15625f },
+    {  0.28125f, -0.21875f,  0.40625f, -0.09375f },
+    { -0.31250f,  0.18750f, -0.43750f,  0.06250f },
+    {  0.43750f, -0.06250f,  0.31250f, -0.18750f },
+  };
+
+  float exposure = opt.exposure == 0.0f ? 1.0f : opt.exposure;
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgbaf fallback_row[64];
+  size_t row_capacity = src->width;
+  Pixels_Rgbaf *row_f = NULL;
+  if (src->half_pixels != NULL) {
+    row_f = pixels_temp_alloc(sizeof(Pixels_Rgbaf)*row_capacity);
+    if (row_f == NULL) {
+      row_f = fallback_row;
+      row_capacity = PIXELS_ARRAY_LEN(fallback_row);
+    }
+  }
+
+  for (int y = 0; y < src->height; ++y) {
+    for (int x0 = 0; x0 < src->width;) {
+      size_t count = PIXELS_MIN((size_t)pixels__contiguous_run(dst, x0, src->width), row_capacity);
+      size_t at = (size_t)y*src->width + x0;
+      const Pixels_Rgbaf *in = src->pixels + at;
+      if (src->half_pixels != NULL) {
+        pixels__half_to_rgbaf(row_f, src->half_pixels + at, count);
+        in = row_f;
+      }
+      Pixels_Rgba *out = pixels_get_pixel(dst, x0, y);
+      for (size_t i = 0; i < count; ++i) {
+        float d = opt.dither ? bayer[y & 3][(x0 + i) & 3] : 0.0f;
+        int32_t idx[4];
+#ifdef PIXELS_SSE2
+        __m128 c = _mm_mul_ps(_mm_loadu_ps(&in[i].red), _mm_set1_ps(exposure));
+        c = _mm_max_ps(c, _mm_setzero_ps());
+        if (opt.op == PIXELS_TONEMAP_REINHARD) {
+          c = _mm_div_ps(c, _mm_add_ps(_mm_set1_ps(1.0f), c));
+        } else if (opt.op == PIXELS_TONEMAP_ACES) {
+          __m128 num = _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), c), _mm_set1_ps(0.03f)));
+          __m128 den = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), c), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+          c = _mm_div_ps(num, den);
+        }
+        const __m128 lut_max = _mm_set1_ps((float)(PIXELS_LINEAR_LUT_SIZE - 1));
+        __m128 t = _mm_add_ps(_mm_mul_ps(c, lut_max), _mm_set1_ps(0.5f));
+        _mm_storeu_si128((__m128i*)idx, _mm_cvttps_epi32(_mm_min_ps(t, lut_max)));
+#else
+        float c[3] = { in[i].red, in[i].green, in[i].blue };
+        for (int ch = 0; ch < 3; ++ch) {
+          idx[ch] = pixels__linear_lut_index(pixels__tonemap_channel(opt.op, PIXELS_MAX(c[ch] * exposure, 0.0f)));
+        }
+#endif // PIXELS_SSE2
+        out[i].red   = (unsigned char)PIXELS_CLAMP(srgbf[idx[0]] + d + 0.5f, 0.0f, 255.0f);
+        out[i].green = (unsigned char)PIXELS_CLAMP(srgbf[idx[1]] + d + 0.5f, 0.0f, 255.0f);
+        out[i].blue  = (unsigned char)PIXELS_CLAMP(srgbf[idx[2]] + d + 0.5f, 0.0f, 255.0f);
+        // Alpha is coverage, it doesn't get exposure or a curve
+        out[i].alpha = (unsigned char)PIXELS_CLAMP(in[i].alpha * 255.0f + d + 0.5f, 0.0f, 255.0f);
+      }
+      if (dst->flags & PIXELS_CANVAS_PREMULTIPLIED) pixels_premultiply_span(out, count);
+      x0 += count;
+    }
+  }
+
+  pixels_temp_rewind(checkpoint);
+  return true;
+}
+
+
+// Conversions of every format in PIXELS_FORMATS, the template below calls them by name
+static inline Pixels_Bgra8 pixels__encode_bgra8(Pixels_Rgba c) {
+  Pixels_Bgra8 out = { c.blue, c.green, c.red, c.alpha };
+  return out;
+}
+
+static inline Pixels_Rgba pixels__decode_bgra8(Pixels_Bgra8 p) {
+  Pixels_Rgba out = { p.red, p.green, p.blue, p.alpha };
+  return out;
+}
+
+static inline uint16_t pixels__encode_rgb565(Pixels_Rgba c) {
+  unsigned int r = (c.red*31 + 127) / 255, g = (c.green*63 + 127) / 255, b = (c.blue*31 + 127) / 255;
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline Pixels_Rgba pixels__decode_rgb565(uint16_t p) {
+  unsigned int r = p >> 11, g = (p >> 5) & 0x3F, b = p & 0x1F;
+  Pixels_Rgba out = { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255 };
+  return out;
+}
+
+// Rec. 709 luma with weights scaled to add up to 256
+static inline unsigned char pixels__encode_gray8(Pixels_Rgba c) {
+  return (unsigned char)((c.red*54 + c.green*183 + c.blue*19 + 128) >> 8);
+}
+
+static inline Pixels_Rgba pixels__decode_gray8(unsigned char p) {
+  Pixels_Rgba out = { p, p, p, 255 };
+  return out;
+}
+
+static inline Pixels_Rgbah pixels__encode_rgba16f(Pixels_Rgba c) {
+  Pixels_Rgbah out = {
+    pixels_float_to_half(c.red / 255.0f), pixels_float_to_half(c.green / 255.0f),
+    pixels_float_to_half(c.blue / 255.0f), pixels_float_to_half(c.alpha / 255.0f),
+  };
+  return out;
+}
+
+static inline Pixels_Rgba pixels__decode_rgba16f(Pixels_Rgbah p) {
+  Pixels_Rgba out = {
+    pixels_float_to_uchar_round_clamp(pixels_half_to_float(p.red) * 255.0f),
+    pixels_float_to_uchar_round_clamp(pixels_half_to_float(p.green) * 255.0f),
+    pixels_float_to_uchar_round_clamp(pixels_half_to_float(p.blue) * 255.0f),
+    pixels_float_to_uchar_round_clamp(pixels_half_to_float(p.alpha) * 255.0f),
+  };
+  return out;
+}
+
+// Replace encodes straight into the row. Blending decodes the covered part of the row, blends it with
+// the same SIMD kernel as Pixels_Canvas and encodes it back.
+#define PIXELS__IMPLEMENT_FORMAT(Name, name, Pixel) \
+  Pixels_Canvas_##Name pixels_create_canvas_##name(int width, int height) { \
+    Pixels_Canvas_##Name cnv = {0}; \
+    size_t count; \
+    if (!pixels__canvas_count(width, height, PIXELS_LAYOUT_LINEAR, sizeof(Pixel), 0, &count)) return cnv; \
+    cnv.pixels = PIXELS_MALLOC(sizeof(Pixel)*count); \
+    if (cnv.pixels == NULL) return cnv; \
+    cnv.width = width; \
+    cnv.height = height; \
+    cnv.count = count; \
+    Pixel black = pixels__encode_##name((Pixels_Rgba) { 0, 0, 0, 255 }); \
+    for (size_t i = 0; i < cnv.count; ++i) cnv.pixels[i] = black; \
+    return cnv; \
+  } \
+  \
+  void pixels_destroy_canvas_##name(Pixels_Canvas_##Name *cnv) { \
+    PIXELS_FREE(cnv->pixels); \
+    cnv->pixels = NULL; \
+    cnv->count = 0; \
+  } \
+  \
+  void pixels_render_triangle_##name(Pixels_Canvas_##Name *cnv, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Render_Opt opt) { \
+    Pixels__Raster_Tri rt; \
+    if (!pixels__setup_triangle(&rt, cnv->width, cnv->height, 0, camera, tri)) return; \
+    Pixels__Linear_Shading ls; \
+    if (opt.linear_light) pixels__setup_linear_shading(&ls, &rt); \
+    bool direct = opt.blend == PIXELS_BLEND_REPLACE && !opt.linear_light; \
+    size_t checkpoint = pixels_temp_save(); \
+    Pixels_Rgba fallback_span[64], fallback_dst[64]; \
+    size_t span_capacity = rt.x1 - rt.x0; \
+    Pixels_Rgba *span = pixels_temp_alloc(sizeof(Pixels_Rgba)*span_capacity); \
+    Pixels_Rgba *dst = pixels_temp_alloc(sizeof(Pixels_Rgba)*span_capacity); \
+    if (span == NULL || dst == NULL) { \
+      span = fallback_span; \
+      dst = fallback_dst; \
+      span_capacity = PIXELS_ARRAY_LEN(fallback_span); \
+    } \
+    for (int y = rt.y0; y < rt.y1; ++y) { \
+      Pixel *row = cnv->pixels + (size_t)y*cnv->width; \
+      int x = rt.x0, run_end; \
+      while (pixels__raster_next_run(&rt, y, &x, &run_end)) { \
+        if (direct) { \
+          for (; x < run_end; ++x) row[x] = pixels__encode_##name(pixels__raster_trilerp(&rt, x, y)); \
+          continue; \
+        } \
+        while (x < run_end) { \
+          size_t count = PIXELS_MIN((size_t)(run_end - x), span_capacity); \
+          pixels__shade_span(span, count, &rt, opt.linear_light ? &ls : NULL, x, y); \
+          if (opt.blend != PIXELS_BLEND_REPLACE) { \
+            for (size_t i = 0; i < count; ++i) dst[i] = pixels__decode_##name(row[x + i]); \
+            pixels_blend_span(dst, span, count, opt.blend); \
+            for (size_t i = 0; i < count; ++i) row[x + i] = pixels__encode_##name(dst[i]); \
+          } else { \
+            for (size_t i = 0; i < count; ++i) row[x + i] = pixels__encode_##name(span[i]); \
+          } \
+          x += count; \
+        } \
+      } \
+    } \
+    pixels_temp_rewind(checkpoint); \
+  } \
+  \
+  void pixels_canvas_##name##_to_rgba(const Pixels_Canvas_##Name *cnv, Pixels_Rgba *out) { \
+    for (size_t i = 0; i < cnv->count; ++i) out[i] = pixels__decode_##name(cnv->pixels[i]); \
+  }
+PIXELS_FORMATS(PIXELS__IMPLEMENT_FORMAT)
+
+Pixels_Canvas_Indexed pixels_create_canvas_indexed(int width, int height) {
+  Pixels_Canvas_Indexed cnv = {0};
+  cnv.palette[0].alpha = 255;
+  cnv.palette_count = 1;
+  size_t count;
+  if (!pixels__canvas_count(width, height, PIXELS_LAYOUT_LINEAR, 1, 0, &count)) return cnv;
+  cnv.indices = PIXELS_MALLOC(count);
+  if (cnv.indices == NULL) return cnv;
+  memset(cnv.indices, 0, count);
+  cnv.width = width;
+  cnv.height = height;
+  cnv.count = count;
+  return cnv;
+}
+
+void pixels_destroy_canvas_indexed(Pixels_Canvas_Indexed *cnv) {
+  PIXELS_FREE(cnv->indices);
+  cnv->indices = NULL;
+  cnv->count = 0;
+}
+
+int pixels_palette_index(Pixels_Canvas_Indexed *cnv, Pixels_Rgba color) {
+  for (size_t i = 0; i < cnv->palette_count; ++i) {
+    if (memcmp(&cnv->palette[i], &color, sizeof(color)) == 0) return (int)i;
+  }
+  if (cnv->palette_count >= PIXELS_PALETTE_CAPACITY) return -1;
+  cnv->palette[cnv->palette_count] = color;
+  return (int)cnv->palette_count++;
+}
+
+void pixels_render_triangle_index(Pixels_Canvas_Indexed *cnv, Pixels_Camera camera, Pixels_Triangle tri, unsigned char index) {
+  if (index >= cnv->palette_count) return;
+  Pixels__Raster_Tri rt;
+  if (!pixels__setup_triangle(&rt, cnv->width, cnv->height, 0, camera, tri)) return;
+  for (int y = rt.y0; y < rt.y1; ++y) {
+    unsigned char *row = cnv->indices + (size_t)y*cnv->width;
+    int x = rt.x0, run_end;
+    while (pixels__raster_next_run(&rt, y, &x, &run_end)) {
+      memset(row + x, index, run_end - x);
+      x = run_end;
+    }
+  }
+}
+
+bool pixels_render_triangle_indexed(Pixels_Canvas_Indexed *cnv, Pixels_Camera camera, Pixels_Triangle tri) {
+  int index = pixels_palette_index(cnv, tri.a.color);
+  if (index < 0) return false;
+  pixels_render_triangle_index(cnv, camera, tri, (unsigned char)index);
+  return true;
+}
+
+void pixels_canvas_indexed_to_rgba(const Pixels_Canvas_Indexed *cnv, Pixels_Rgba *out) {
+  size_t i = 0;
+#ifdef PIXELS_SSSE3
+  if (cnv->palette_count <= 16) {
+    // One 16 byte table per channel. The shuffle only looks at the low 4 bits, so indices past palette_count
+    // get their high bit set, which makes it output 0 instead of wrapping around to another color.
+    unsigned char tables[4][16] = {0};
+    for (size_t k = 0; k < cnv->palette_count; ++k) {
+      tables[0][k] = cnv->palette[k].red;
+      tables[1][k] = cnv->palette[k].green;
+      tables[2][k] = cnv->palette[k].blue;
+      tables[3][k] = cnv->palette[k].alpha;
+    }
+    __m128i rt = _mm_loadu_si128((const __m128i*)tables[0]);
+    __m128i gt = _mm_loadu_si128((const __m128i*)tables[1]);
+    __m128i bt = _mm_loadu_si128((const __m128i*)tables[2]);
+    __m128i at = _mm_loadu_si128((const __m128i*)tables[3]);
+    __m128i limit = _mm_set1_epi8((char)cnv->palette_count);
+    for (; i + 16 <= cnv->count; i += 16) {
+      __m128i idx = _mm_loadu_si128((const __m128i*)(cnv->indices + i));
+      idx = _mm_or_si128(idx, _mm_cmpeq_epi8(_mm_max_epu8(idx, limit), idx));
+      __m128i r = _mm_shuffle_epi8(rt, idx);
+      __m128i g = _mm_shuffle_epi8(gt, idx);
+      __m128i b = _mm_shuffle_epi8(bt, idx);
+      __m128i a = _mm_shuffle_epi8(at, idx);
+      __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+      __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+      _mm_storeu_si128((__m128i*)(out + i),      _mm_unpacklo_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128((__m128i*)(out + i + 4),  _mm_unpackhi_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128((__m128i*)(out + i + 8),  _mm_unpacklo_epi16(rg_hi, ba_hi));
+      _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+  }
+#endif // PIXELS_SSSE3
+  for (; i < cnv->count; ++i) {
+    unsigned char index = cnv->indices[i];
+    out[i] = index < cnv->palette_count ? cnv->palette[index] : (Pixels_Rgba) { 0, 0, 0, 0 };
+  }
+}
+
+
+Pixels_Mask pixels_create_mask(int width, int height) {
+  Pixels_Mask mask = {0};
+  size_t count;
+  if (width <= 0) return mask;
+  size_t words_per_row = ((size_t)width + 63) / 64;
+  if (!pixels__canvas_count(words_per_row, height, PIXELS_LAYOUT_LINEAR, sizeof(uint64_t), 0, &count)) return mask;
+  mask.bits = PIXELS_MALLOC(sizeof(uint64_t)*count);
+  if (mask.bits == NULL) return mask;
+  mask.width = width;
+  mask.height = height;
+  mask.words_per_row = words_per_row;
+  if (mask.bits != NULL) pixels_mask_clear(&mask);
+  return mask;
+}
+
+void pixels_destroy_mask(Pixels_Mask *mask) {
+  PIXELS_FREE(mask->bits);
+  mask->bits = NULL;
+}
+
+void pixels_mask_clear(Pixels_Mask *mask) {
+  if (mask->bits == NULL) return;
+  memset(mask->bits, 0, sizeof(uint64_t)*mask->words_per_row*mask->height);
+}
+
+// Applies [x0, x1) of a row, only the words at either end need a partial mask.
+// AND clears the span, it gets called on the gaps between the covered runs.
+static void pixels__mask_span(uint64_t *row, int x0, int x1, Pixels_Mask_Op op) {
+  size_t first = x0 >> 6, last = (x1 - 1) >> 6;
+  uint64_t head = ~(uint64_t)0 << (x0 & 63);
+  uint64_t tail = ~(uint64_t)0 >> (63 - ((x1 - 1) & 63));
+  if (first == last) {
+    uint64_t bits = head & tail;
+    if (op == PIXELS_MASK_XOR) row[first] ^= bits;
+    else if (op == PIXELS_MASK_AND) row[first] &= ~bits;
+    else row[first] |= bits;
+    return;
+  }
+  if (op == PIXELS_MASK_XOR) {
+    row[first] ^= head;
+    for (size_t w = first + 1; w < last; ++w) row[w] = ~row[w];
+    row[last] ^= tail;
+  } else if (op == PIXELS_MASK_AND) {
+    row[first] &= ~head;
+    for (size_t w = first + 1; w < last; ++w) row[w] = 0;
+    row[last] &= ~tail;
+  } else {
+    row[first] |= head;
+    for (size_t w = first + 1; w < last; ++w) row[w] = ~(uint64_t)0;
+    row[last] |= tail;
+  }
+}
+
+void pixels_render_triangle_mask(Pixels_Mask *mask, Pixels_Camera camera, Pixels_Triangle tri, Pixels_Mask_Op op) {
+  Pixels__Raster_Tri rt;
+  if (!pixels__setup_triangle(&rt, mask->width, mask->height, 0, camera, tri)) {
+    if (op == PIXELS_MASK_AND) pixels_mask_clear(mask);
+    return;
+  }
+
+  // Intersection clears the gaps between the runs instead of building the coverage on the side,
+  // so it needs no scratch. Rows the triangle misses are cleared whole.
+  if (op == PIXELS_MASK_AND) {
+    memset(mask->bits, 0, sizeof(uint64_t)*mask->words_per_row*rt.y0);
+    memset(mask->bits + mask->words_per_row*rt.y1, 0, sizeof(uint64_t)*mask->words_per_row*(mask->height - rt.y1));
+  }
+
+  for (int y = rt.y0; y < rt.y1; ++y) {
+    uint64_t *row = mask->bits + (size_t)y*mask->words_per_row;
+    int x = rt.x0, run_end, cleared = 0;
+    while (pixels__raster_next_run(&rt, y, &x, &run_end)) {
+      if (op != PIXELS_MASK_AND) pixels__mask_span(row, x, run_end, op);
+      else if (cleared < x) pixels__mask_span(row, cleared, x, op);
+      cleared = x = run_end;
+    }
+    if (op == PIXELS_MASK_AND && cleared < mask->width) pixels__mask_span(row, cleared, mask->width, op);
+  }
+}
+
+// Slicing by 8, table k is the CRC of a byte followed by k zero bytes
+static uint32_t pixels__crc_table[8][256];
+static uint8_t pixels__fixed_lit_len[288];
+static uint16_t pixels__fixed_lit_code[288];
+// Length symbol for every match length 3..258 and distance code for 1..256 and (d-1)>>7 of the rest, like zlib does
+static uint8_t pixels__len_symbol[259];
+static uint8_t pixels__dist_symbol[512];
+
+static const uint16_t pixels__len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t pixels__len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t pixels__dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t pixels__dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Huffman codes are sent most significant bit first while everything else in deflate goes least significant first
+static uint32_t pixels__reverse_bits(uint32_t code, int length) {
+  uint32_t out = 0;
+  for (int i = 0; i < length; ++i) {
+    out = (out << 1) | (code & 1);
+    code >>= 1;
+  }
+  return out;
+}
+
+static void pixels__build_deflate_tables(void) {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    pixels__crc_table[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (int k = 1; k < 8; ++k) {
+      uint32_t c = pixels__crc_table[k - 1][i];
+      pixels__crc_table[k][i] = pixels__crc_table[0][c & 0xFF] ^ (c >> 8);
+    }
+  }
+  // Fixed literal/length codes from RFC 1951 3.2.6
+  for (int sym = 0; sym < 288; ++sym) {
+    uint32_t code;
+    int length;
+    if (sym < 144)      { code = 0x30 + sym;          length = 8; }
+    else if (sym < 256) { code = 0x190 + (sym - 144); length = 9; }
+    else if (sym < 280) { code = sym - 256;           length = 7; }
+    else                { code = 0xC0 + (sym - 280);  length = 8; }
+    pixels__fixed_lit_code[sym] = pixels__reverse_bits(code, length);
+    pixels__fixed_lit_len[sym] = length;
+  }
+  for (int sym = 0; sym < 29; ++sym) {
+    int last = sym + 1 < 29 ? pixels__len_base[sym + 1] : 259;
+    for (int len = pixels__len_base[sym]; len < last; ++len) pixels__len_symbol[len] = sym;
+  }
+  // 258 has a symbol of its own even though 227 + 31 would reach it
+  pixels__len_symbol[258] = 28;
+  for (int sym = 0; sym < 30; ++sym) {
+    int last = sym + 1 < 30 ? pixels__dist_base[sym + 1] : 32769;
+    for (int dist = pixels__dist_base[sym]; dist < last; ++dist) {
+      if (dist <= 256) pixels__dist_symbol[dist - 1] = sym;
+      else pixels__dist_symbol[256 + ((dist - 1) >> 7)] = sym;
+    }
+  }
+}
+
+// PNG encoders can start on several threads at once (band workers, async writers), only one of them builds the tables
+#ifdef PIXELS_PTHREADS
+static pthread_once_t pixels__deflate_tables_once = PTHREAD_ONCE_INIT;
+static void pixels__init_deflate_tables(void) {
+  pthread_once(&pixels__deflate_tables_once, pixels__build_deflate_tables);
+}
+#else
+static bool pixels__deflate_tables_ready = false;
+static void pixels__init_deflate_tables(void) {
+  if (pixels__deflate_tables_ready) return;
+  pixels__build_deflate_tables();
+  pixels__deflate_tables_ready = true;
+}
+#endif // PIXELS_PTHREADS
+
+static uint32_t pixels__crc32_update(uint32_t crc, const unsigned char *data, size_t size) {
+  crc = ~crc;
+  while (size >= 8) {
+    uint32_t lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24));
+    uint32_t hi = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+    crc = pixels__crc_table[7][lo & 0xFF] ^ pixels__crc_table[6][(lo >> 8) & 0xFF] ^
+          pixels__crc_table[5][(lo >> 16) & 0xFF] ^ pixels__crc_table[4][lo >> 24] ^
+          pixels__crc_table[3][hi & 0xFF] ^ pixels__crc_table[2][(hi >> 8) & 0xFF] ^
+          pixels__crc_table[1][(hi >> 16) & 0xFF] ^ pixels__crc_table[0][hi >> 24];
+    data += 8;
+    size -= 8;
+  }
+  for (size_t i = 0; i < size; ++i) crc = pixels__crc_table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+#ifdef PIXELS_SSE2
+static inline uint32_t pixels__sse2_hsum_epi32(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t)_mm_cvtsi128_si32(v);
+}
+#endif // PIXELS_SSE2
+
+static uint32_t pixels__adler32_update(uint32_t adler, const unsigned char *data, size_t size) {
+  uint32_t a = adler & 0xFFFF, b = adler >> 16;
+#ifdef PIXELS_SSE2
+  // 16 bytes at a time: b picks up 16*a for every block plus the block's bytes weighted 16 down to 1
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+  while (size >= 16) {
+    size_t n = PIXELS_MIN(size, (size_t)5552) & ~(size_t)15;
+    __m128i sum = zero, prev_sums = zero, weighted = zero;
+    for (size_t i = 0; i < n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+      prev_sums = _mm_add_epi32(prev_sums, sum);
+      sum = _mm_add_epi32(sum, _mm_sad_epu8(x, zero));
+      weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(x, zero), weights_lo));
+      weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), weights_hi));
+    }
+    uint64_t bytes = pixels__sse2_hsum_epi32(sum);
+    b = (uint32_t)((b + (uint64_t)n*a + 16*(uint64_t)pixels__sse2_hsum_epi32(prev_sums) + pixels__sse2_hsum_epi32(weighted)) % 65521);
+    a = (uint32_t)((a + bytes) % 65521);
+    data += n;
+    size -= n;
+  }
+#endif // PIXELS_SSE2
+  while (size > 0) {
+    // Largest run that can't overflow b before the modulo
+    size_t n = PIXELS_MIN(size, (size_t)5552);
+    for (size_t i = 0; i < n; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += n;
+    size -= n;
+  }
+  return (b << 16) | a;
+}
+
+// Checksum of two pieces glued together from their own checksums, straight out of zlib
+static uint32_t pixels__adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2) {
+  const uint32_t base = 65521;
+  uint32_t rem = size2 % base;
+  uint32_t sum1 = adler1 & 0xFFFF;
+  uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % base);
+  sum1 += (adler2 & 0xFFFF) + base - 1;
+  sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + base - rem;
+  if (sum1 >= base) sum1 -= base;
+  if (sum1 >= base) sum1 -= base;
+  if (sum2 >= (base << 1)) sum2 -= (base << 1);
+  if (sum2 >= base) sum2 -= base;
+  return sum1 | (sum2 << 16);
+}
+
+static void pixels__deflate_drain(Pixels_Deflate *z) {
+  if (z->out_size > 0 && !z->failed) z->failed = !z->emit(z->user, z->out, z->out_size);
+  z->out_size = 0;
+}
+
+static inline void pixels__deflate_bits(Pixels_Deflate *z, uint32_t value, int count) {
+  z->bits |= (uint64_t)value << z->bit_count;
+  z->bit_count += count;
+  if (z->bit_count >= 32) {
+    if (z->out_size + 4 > PIXELS_PNG_CHUNK_SIZE) pixels__deflate_drain(z);
+    z->out[z->out_size++] = z->bits;
+    z->out[z->out_size++] = z->bits >> 8;
+    z->out[z->out_size++] = z->bits >> 16;
+    z->out[z->out_size++] = z->bits >> 24;
+    z->bits >>= 32;
+    z->bit_count -= 32;
+  }
+}
+
+// Pads with zero bits up to the next byte and pushes every whole byte into out
+static void pixels__deflate_align(Pixels_Deflate *z) {
+  int pad = (8 - (z->bit_count & 7)) & 7;
+  z->bit_count += pad;
+  while (z->bit_count > 0) {
+    if (z->out_size + 1 > PIXELS_PNG_CHUNK_SIZE) pixels__deflate_drain(z);
+    z->out[z->out_size++] = z->bits;
+    z->bits >>= 8;
+    z->bit_count -= 8;
+  }
+  z->bits = 0;
+  z->bit_count = 0;
+}
+
+static inline void pixels__deflate_literal(Pixels_Deflate *z, int sym) {
+  pixels__deflate_bits(z, pixels__fixed_lit_code[sym], pixels__fixed_lit_len[sym]);
+}
+
+static inline void pixels__deflate_match(Pixels_Deflate *z, int length, int dist) {
+  int lsym = pixels__len_symbol[length];
+  pixels__deflate_literal(z, 257 + lsym);
+  if (pixels__len_extra[lsym]) pixels__deflate_bits(z, length - pixels__len_base[lsym], pixels__len_extra[lsym]);
+  int dsym = dist <= 256 ? pixels__dist_symbol[dist - 1] : pixels__dist_symbol[256 + ((dist - 1) >> 7)];
+  // Fixed distance codes are just the 5 bit symbol
+  pixels__deflate_bits(z, pixels__reverse_bits(dsym, 5), 5);
+  if (pixels__dist_extra[dsym]) pixels__deflate_bits(z, dist - pixels__dist_base[dsym], pixels__dist_extra[dsym]);
+}
+
+static inline uint32_t pixels__deflate_hash(const unsigned char *p) {
+  uint32_t v = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  return (v * 2654435761u) >> (32 - PIXELS_DEFLATE_HASH_BITS);
+}
+
+static inline void pixels__deflate_insert(Pixels_Deflate *z, size_t pos) {
+  uint32_t h = pixels__deflate_hash(z->window + pos);
+  z->prev[pos & (PIXELS_DEFLATE_WINDOW - 1)] = z->head[h];
+  z->head[h] = (int32_t)pos;
+}
+
+// Starts a fixed Huffman block
+static void pixels__deflate_block(Pixels_Deflate *z, bool final) {
+  pixels__deflate_bits(z, final ? 1 : 0, 1);
+  pixels__deflate_bits(z, 1, 2);
+}
+
+// Scratch comes from the temp arena, false if it didn't fit
+static bool pixels__deflate_init(Pixels_Deflate *z, Pixels_Write_Fn emit, void *user, int max_chain) {
+  pixels__init_deflate_tables();
+  memset(z, 0, sizeof(*z));
+  z->window = pixels_temp_alloc(2*PIXELS_DEFLATE_WINDOW);
+  z->out = pixels_temp_alloc(PIXELS_PNG_CHUNK_SIZE);
+  if (max_chain > 0) {
+    z->head = pixels_temp_alloc(sizeof(int32_t) << PIXELS_DEFLATE_HASH_BITS);
+    z->prev = pixels_temp_alloc(sizeof(int32_t)*PIXELS_DEFLATE_WINDOW);
+    if (z->head == NULL || z->prev == NULL) return false;
+    memset(z->head, 0xFF, sizeof(int32_t) << PIXELS_DEFLATE_HASH_BITS);
+  }
+  if (z->window == NULL || z->out == NULL) return false;
+  z->adler = 1;
+  z->max_chain = max_chain;
+  z->emit = emit;
+  z->user = user;
+  return true;
+}
+
+// Greedy parse of [pos, limit), matches may run past limit up to the end of the input
+static void pixels__deflate_compress(Pixels_Deflate *z, size_t limit) {
+  const unsigned char *w = z->window;
+  size_t pos = z->pos;
+  while (pos < limit) {
+    size_t avail = z->end - pos;
+    int best_len = 0, best_dist = 0;
+    if (avail >= 3) {
+      uint32_t h = pixels__deflate_hash(w + pos);
+      int32_t cand = z->head[h];
+      z->prev[pos & (PIXELS_DEFLATE_WINDOW - 1)] = cand;
+      z->head[h] = (int32_t)pos;
+      int max_len = (int)PIXELS_MIN(avail, (size_t)258);
+      for (int chain = z->max_chain; cand >= 0 && chain > 0; --chain) {
+        size_t dist = pos - cand;
+        if (dist >= PIXELS_DEFLATE_WINDOW) break;
+        if (w[cand + best_len] == w[pos + best_len]) {
+          int len = 0;
+          while (len < max_len && w[cand + len] == w[pos + len]) ++len;
+          if (len > best_len) {
+            best_len = len;
+            best_dist = (int)dist;
+            if (len == max_len) break;
+          }
+        }
+        cand = z->prev[cand & (PIXELS_DEFLATE_WINDOW - 1)];
+      }
+    }
+    if (best_len >= 3) {
+      pixels__deflate_match(z, best_len, best_dist);
+      for (size_t p = pos + 1; p < pos + best_len && p + 3 <= z->end; ++p) pixels__deflate_insert(z, p);
+      pos += best_len;
+    } else {
+      pixels__deflate_literal(z, w[pos]);
+      pos += 1;
+    }
+  }
+  z->pos = pos;
+}
+
+// Fast mode parse: the only matches tried are repeats of the previous byte or pixel, which is most of what
+// filtered rendered rows look like. No hashing at all, so it runs close to memory speed.
+static void pixels__deflate_compress_rle(Pixels_Deflate *z, size_t limit) {
+  const unsigned char *w = z->window;
+  size_t pos = z->pos;
+  while (pos < limit) {
+    size_t max_len = PIXELS_MIN(z->end - pos, (size_t)258);
+    int best_len = 0, best_dist = 0;
+    static const int dists[2] = { 4, 1 };
+    for (int i = 0; i < 2 && max_len >= 3; ++i) {
+      size_t dist = dists[i];
+      if (pos < dist) continue;
+      // Most positions don't start a run, three bytes tell
+      if (w[pos] != w[pos - dist] || w[pos + 1] != w[pos + 1 - dist] || w[pos + 2] != w[pos + 2 - dist]) continue;
+      size_t len = 0;
+      // Eight bytes at a time until they differ
+      while (len + 8 <= max_len) {
+        uint64_t x, y;
+        memcpy(&x, w + pos + len, 8);
+        memcpy(&y, w + pos + len - dist, 8);
+        if (x != y) break;
+        len += 8;
+      }
+      while (len < max_len && w[pos + len] == w[pos + len - dist]) ++len;
+      if ((int)len > best_len) {
+        best_len = (int)len;
+        best_dist = (int)dist;
+      }
+    }
+    if (best_len >= 3) {
+      pixels__deflate_match(z, best_len, best_dist);
+      pos += best_len;
+    } else {
+      pixels__deflate_literal(z, w[pos]);
+      pos += 1;
+    }
+  }
+  z->pos = pos;
+}
+
+static inline void pixels__deflate_parse(Pixels_Deflate *z, size_t limit) {
+  if (z->max_chain == 0) pixels__deflate_compress_rle(z, limit);
+  else pixels__deflate_compress(z, limit);
+}
+
+// Drops the older half of the window once the buffer is full
+static void pixels__deflate_slide(Pixels_Deflate *z) {
+  memmove(z->window, z->window + PIXELS_DEFLATE_WINDOW, PIXELS_DEFLATE_WINDOW);
+  z->pos -= PIXELS_DEFLATE_WINDOW;
+  z->end -= PIXELS_DEFLATE_WINDOW;
+  // Run matching doesn't keep any chains
+  if (z->max_chain == 0) return;
+  for (size_t i = 0; i < ((size_t)1 << PIXELS_DEFLATE_HASH_BITS); ++i) {
+    z->head[i] = z->head[i] >= PIXELS_DEFLATE_WINDOW ? z->head[i] - PIXELS_DEFLATE_WINDOW : -1;
+  }
+  for (size_t i = 0; i < PIXELS_DEFLATE_WINDOW; ++i) {
+    z->prev[i] = z->prev[i] >= PIXELS_DEFLATE_WINDOW ? z->prev[i] - PIXELS_DEFLATE_WINDOW : -1;
+  }
+}
+
+static void pixels__deflate_feed(Pixels_Deflate *z, const unsigned char *data, size_t size) {
+  z->adler = pixels__adler32_update(z->adler, data, size);
+  while (size > 0) {
+    if (z->end == 2*PIXELS_DEFLATE_WINDOW) {
+      // Keep a full match worth of lookahead so nothing gets cut short at the buffer edge
+      pixels__deflate_parse(z, z->end - 258);
+      pixels__deflate_slide(z);
+    }
+    size_t n = PIXELS_MIN(size, 2*PIXELS_DEFLATE_WINDOW - z->end);
+    memcpy(z->window + z->end, data, n);
+    z->end += n;
+    data += n;
+    size -= n;
+  }
+}
+
+// Compresses everything buffered and closes the block. Non final blocks are followed by an empty stored block,
+// a sync flush, so the stream ends on a byte boundary and whatever comes next has to start a new block.
+static void pixels__deflate_flush(Pixels_Deflate *z, bool final) {
+  pixels__deflate_parse(z, z->end);
+  pixels__deflate_literal(z, 256);
+  if (!final) {
+    pixels__deflate_bits(z, 0, 3);
+    pixels__deflate_align(z);
+    pixels__deflate_bits(z, 0xFFFF0000u, 32);
+  } else {
+    pixels__deflate_align(z);
+  }
+}
+
+static void pixels__put_be32(unsigned char *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static bool pixels__png_chunk(Pixels_Png_Writer *png, const char *type, const void *data, size_t size) {
+  unsigned char header[8], footer[4];
+  pixels__put_be32(header, (uint32_t)size);
+  memcpy(header + 4, type, 4);
+  uint32_t crc = pixels__crc32_update(0, header + 4, 4);
+  crc = pixels__crc32_update(crc, data, size);
+  pixels__put_be32(footer, crc);
+  return png->write(png->user, header, 8) && (size == 0 || png->write(png->user, data, size)) && png->write(png->user, footer, 4);
+}
+
+// Deflate output goes straight out as IDAT chunks
+static bool pixels__png_emit_idat(void *user, const void *data, size_t size) {
+  return pixels__png_chunk(user, "IDAT", data, size);
+}
+
+#ifdef PIXELS_POSIX
+static bool pixels__write_fd(void *user, const void *data, size_t size) {
+  int fd = (int)(intptr_t)user;
+  const unsigned char *bytes = data;
+  while (size > 0) {
+    ssize_t n = write(fd, bytes, size);
+    if (n <= 0) return false;
+    bytes += n;
+    size -= n;
+  }
+  return true;
+}
+#endif // PIXELS_POSIX
+
+// Appends to a fixed size buffer, anything past the capacity fails the write
+typedef struct {
+  unsigned char *data;
+  size_t size, capacity;
+} Pixels__Buffer_Sink;
+
+static bool pixels__write_buffer(void *user, const void *data, size_t size) {
+  Pixels__Buffer_Sink *sink = user;
+  if (size > sink->capacity - sink->size) return false;
+  memcpy(sink->data + sink->size, data, size);
+  sink->size += size;
+  return true;
+}
+
+bool pixels_png_init(Pixels_Png_Writer *png, int fd, int width, int height) {
+#ifdef PIXELS_POSIX
+  return pixels_png_init_to_func(png, pixels__write_fd, (void*)(intptr_t)fd, width, height);
+#else
+  (void)fd;
+  memset(png, 0, sizeof(*png));
+  png->width = width;
+  png->height = height;
+  png->failed = true;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+// Chain length of the default mode, enough to catch the repeats of rendered images without crawling
+#define PIXELS__PNG_MAX_CHAIN 32
+
+bool pixels_png_init_to_func(Pixels_Png_Writer *png, Pixels_Write_Fn write, void *user, int width, int height) {
+  memset(png, 0, sizeof(*png));
+  png->write = write;
+  png->user = user;
+  png->width = width;
+  png->height = height;
+  png->checkpoint = pixels_temp_save();
+  // IHDR can't hold an empty image
+  if (width <= 0 || height <= 0) {
+    png->failed = true;
+    return false;
+  }
+
+  size_t row_size = 1 + (size_t)width*4;
+  png->prev_row = pixels_temp_alloc(row_size);
+  png->filtered = pixels_temp_alloc(row_size);
+  if (png->prev_row == NULL || png->filtered == NULL ||
+      !pixels__deflate_init(&png->z, pixels__png_emit_idat, png, PIXELS__PNG_MAX_CHAIN)) {
+    pixels_temp_rewind(png->checkpoint);
+    png->failed = true;
+    return false;
+  }
+  // Row before the first one is all zeros as far as the filters care
+  memset(png->prev_row, 0, row_size);
+
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  unsigned char ihdr[13];
+  pixels__put_be32(ihdr, width);
+  pixels__put_be32(ihdr + 4, height);
+  ihdr[8] = 8;  // Bit depth
+  ihdr[9] = 6;  // RGBA
+  ihdr[10] = 0; // Deflate
+  ihdr[11] = 0; // Adaptive filtering
+  ihdr[12] = 0; // No interlacing
+  png->failed = !write(user, signature, sizeof(signature)) || !pixels__png_chunk(png, "IHDR", ihdr, sizeof(ihdr));
+
+  // zlib header, 32K window and no preset dictionary
+  pixels__deflate_bits(&png->z, 0x78, 8);
+  pixels__deflate_bits(&png->z, 0x01, 8);
+  pixels__deflate_block(&png->z, true);
+  return !png->failed;
+}
+
+static inline int pixels__paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  if (pb <= pc) return b;
+  return c;
+}
+
+#ifdef PIXELS_SSE2
+// |v| of signed bytes, as unsigned bytes
+static inline __m128i pixels__sse2_abs_epi8(__m128i v) {
+  return _mm_min_epu8(v, _mm_sub_epi8(_mm_setzero_si128(), v));
+}
+
+static inline __m128i pixels__sse2_abs_epi16(__m128i v) {
+  return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Paeth predictor for 8 bytes widened to 16 bits, same tie breaking as pixels__paeth
+static inline __m128i pixels__sse2_paeth_epi16(__m128i a, __m128i b, __m128i c) {
+  __m128i pa = pixels__sse2_abs_epi16(_mm_sub_epi16(b, c));
+  __m128i pb = pixels__sse2_abs_epi16(_mm_sub_epi16(a, c));
+  __m128i pc = pixels__sse2_abs_epi16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+  __m128i use_a = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)), _mm_set1_epi16(-1));
+  __m128i use_b = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), _mm_set1_epi16(-1));
+  __m128i bc = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+  return _mm_or_si128(_mm_and_si128(use_a, a), _mm_andnot_si128(use_a, bc));
+}
+
+// Prediction of filter 1-4 for 16 bytes, x is the row, a the bytes one pixel to the left, b the row above, c above left
+static inline __m128i pixels__sse2_png_predict(int filter, __m128i a, __m128i b, __m128i c) {
+  const __m128i zero = _mm_setzero_si128();
+  switch (filter) {
+    case 1: return a;
+    case 2: return b;
+    // avg_epu8 rounds up, PNG wants floor
+    case 3: return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+    case 4: {
+      __m128i lo = pixels__sse2_paeth_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+      __m128i hi = pixels__sse2_paeth_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+      return _mm_packus_epi16(lo, hi);
+    }
+  }
+  return zero;
+}
+
+static inline void pixels__sse2_png_neighbours(const unsigned char *row, const unsigned char *prev, size_t i, __m128i *a, __m128i *b, __m128i *c) {
+  *b = _mm_loadu_si128((const __m128i*)(prev + i));
+  if (i == 0) {
+    // Nothing to the left of the first pixel
+    *a = _mm_slli_si128(_mm_loadu_si128((const __m128i*)row), 4);
+    *c = _mm_slli_si128(*b, 4);
+  } else {
+    *a = _mm_loadu_si128((const __m128i*)(row + i - 4));
+    *c = _mm_loadu_si128((const __m128i*)(prev + i - 4));
+  }
+}
+#endif // PIXELS_SSE2
+
+// Filters a row against the previous one with whichever filter gives the smallest sum of absolute differences,
+// the usual heuristic from the PNG spec. out gets the filter type byte followed by the filtered row.
+// SSE2 scores all five filters 16 bytes at a time and comes up with the same choice as the scalar loop.
+static void pixels__png_filter_row(unsigned char *out, const unsigned char *row, const unsigned char *prev, size_t size) {
+  uint32_t sums[5] = {0};
+  size_t start = 0;
+#ifdef PIXELS_SSE2
+  __m128i acc[5];
+  for (int f = 0; f < 5; ++f) acc[f] = _mm_setzero_si128();
+  for (; start + 16 <= size; start += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(row + start)), a, b, c;
+    pixels__sse2_png_neighbours(row, prev, start, &a, &b, &c);
+    acc[0] = _mm_add_epi64(acc[0], _mm_sad_epu8(pixels__sse2_abs_epi8(x), _mm_setzero_si128()));
+    for (int f = 1; f < 5; ++f) {
+      __m128i d = _mm_sub_epi8(x, pixels__sse2_png_predict(f, a, b, c));
+      acc[f] = _mm_add_epi64(acc[f], _mm_sad_epu8(pixels__sse2_abs_epi8(d), _mm_setzero_si128()));
+    }
+  }
+  for (int f = 0; f < 5; ++f) sums[f] = _mm_cvtsi128_si32(acc[f]) + _mm_cvtsi128_si32(_mm_srli_si128(acc[f], 8));
+#endif // PIXELS_SSE2
+  for (size_t i = start; i < size; ++i) {
+    int a = i >= 4 ? row[i - 4] : 0, b = prev[i], c = i >= 4 ? prev[i - 4] : 0;
+    int x = row[i];
+    sums[0] += abs((int8_t)x);
+    sums[1] += abs((int8_t)(x - a));
+    sums[2] += abs((int8_t)(x - b));
+    sums[3] += abs((int8_t)(x - ((a + b) >> 1)));
+    sums[4] += abs((int8_t)(x - pixels__paeth(a, b, c)));
+  }
+  int best = 0;
+  for (int f = 1; f < 5; ++f) if (sums[f] < sums[best]) best = f;
+
+  out[0] = best;
+  size_t i = 0;
+#ifdef PIXELS_SSE2
+  for (; i + 16 <= size; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(row + i)), a, b, c;
+    pixels__sse2_png_neighbours(row, prev, i, &a, &b, &c);
+    _mm_storeu_si128((__m128i*)(out + 1 + i), _mm_sub_epi8(x, pixels__sse2_png_predict(best, a, b, c)));
+  }
+#endif // PIXELS_SSE2
+  for (; i < size; ++i) {
+    int a = i >= 4 ? row[i - 4] : 0, b = prev[i], c = i >= 4 ? prev[i - 4] : 0;
+    int predicted = 0;
+    switch (best) {
+      case 1: predicted = a; break;
+      case 2: predicted = b; break;
+      case 3: predicted = (a + b) >> 1; break;
+      case 4: predicted = pixels__paeth(a, b, c); break;
+    }
+    out[1 + i] = row[i] - predicted;
+  }
+}
+
+bool pixels_png_write_rows(Pixels_Png_Writer *png, const Pixels_Rgba *rows, int count) {
+  if (png->failed || png->rows_written + count > png->height) {
+    png->failed = true;
+    return false;
+  }
+  size_t size = (size_t)png->width*4;
+  for (int y = 0; y < count; ++y) {
+    const unsigned char *row = (const unsigned char*)(rows + (size_t)y*png->width);
+    pixels__png_filter_row(png->filtered, row, png->prev_row, size);
+    pixels__deflate_feed(&png->z, png->filtered, size + 1);
+    memcpy(png->prev_row, row, size);
+  }
+  png->rows_written += count;
+  png->failed = png->z.failed;
+  return !png->failed;
+}
+
+// Row y of the canvas as straight alpha, row major
+static void pixels__canvas_straight_row(const Pixels_Canvas *cnv, int y, Pixels_Rgba *out) {
+  if (cnv->tile_shift == 0) {
+    memcpy(out, pixels_get_pixel(cnv, 0, y), sizeof(Pixels_Rgba)*cnv->width);
+  } else {
+    for (int x = 0; x < cnv->width; x += 1 << cnv->tile_shift) {
+      memcpy(out + x, pixels_get_pixel(cnv, x, y), sizeof(Pixels_Rgba)*pixels__contiguous_run(cnv, x, cnv->width));
+    }
+  }
+  if (cnv->flags & PIXELS_CANVAS_PREMULTIPLIED) pixels_unpremultiply_span(out, out, cnv->width);
+}
+
+bool pixels_png_write_canvas(Pixels_Png_Writer *png, const Pixels_Canvas *cnv) {
+  if (cnv->width != png->width) {
+    png->failed = true;
+    return false;
+  }
+  // Plain canvases are already in the layout PNG wants
+  if (cnv->tile_shift == 0 && !(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED)) {
+    return pixels_png_write_rows(png, cnv->pixels, cnv->height);
+  }
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgba *row = pixels_temp_alloc(sizeof(Pixels_Rgba)*cnv->width);
+  if (row == NULL) {
+    png->failed = true;
+    return false;
+  }
+  for (int y = 0; y < cnv->height && !png->failed; ++y) {
+    pixels__canvas_straight_row(cnv, y, row);
+    pixels_png_write_rows(png, row, 1);
+  }
+  pixels_temp_rewind(checkpoint);
+  return !png->failed;
+}
+
+bool pixels_png_finish(Pixels_Png_Writer *png) {
+  if (png->rows_written != png->height) png->failed = true;
+  if (!png->failed) {
+    pixels__deflate_flush(&png->z, true);
+    unsigned char adler[4];
+    pixels__put_be32(adler, png->z.adler);
+    for (int i = 0; i < 4; ++i) pixels__deflate_bits(&png->z, adler[i], 8);
+    pixels__deflate_align(&png->z);
+    pixels__deflate_drain(&png->z);
+    png->failed = png->z.failed || !pixels__png_chunk(png, "IEND", NULL, 0);
+  }
+  pixels_temp_rewind(png->checkpoint);
+  return !png->failed;
+}
+
+size_t pixels_png_band_rows(int width) {
+  size_t row_size = 1 + (size_t)width*4;
+  return PIXELS_MAX(PIXELS_PNG_BAND_BYTES / row_size, (size_t)1);
+}
+
+// Fixed Huffman never spends more than 9 bits on a literal or 31 on a match of 3 or more, so 11 bits a byte covers it
+static size_t pixels__deflate_bound(size_t size) {
+  return size/8*11 + 64;
+}
+
+typedef struct {
+  const Pixels_Canvas *cnv;
+  int y0, y1;
+  int max_chain;
+  // Worker threads get a scratch arena of their own, NULL runs on the caller's temp arena
+  Pixels_Arena *scratch;
+  unsigned char *data;
+  size_t size, capacity;
+  uint32_t adler;
+  bool ok;
+  // Band number + 1 once data holds it, the slot gets reused band_count/slot_count times
+  size_t done;
+} Pixels__Png_Band;
+
+static bool pixels__png_band_emit(void *user, const void *data, size_t size) {
+  Pixels__Png_Band *band = user;
+  if (size > band->capacity - band->size) return false;
+  memcpy(band->data + band->size, data, size);
+  band->size += size;
+  return true;
+}
+
+// Filters and deflates rows [y0, y1) on their own, ending in a sync flush or the final block for the last band
+static void *pixels__png_band_job(void *arg) {
+  Pixels__Png_Band *band = arg;
+  const Pixels_Canvas *cnv = band->cnv;
+  Pixels_Arena *saved = NULL;
+  if (band->scratch != NULL) {
+    saved = pixels_temp_arena();
+    pixels_set_temp_arena(band->scratch);
+  }
+  size_t checkpoint = pixels_temp_save();
+
+  size_t row_size = (size_t)cnv->width*4;
+  bool direct = cnv->tile_shift == 0 && !(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED);
+  Pixels_Rgba *rows[2] = { pixels_temp_alloc(row_size), pixels_temp_alloc(row_size) };
+  unsigned char *filtered = pixels_temp_alloc(row_size + 1);
+  Pixels_Deflate z;
+  band->size = 0;
+  band->ok = rows[0] != NULL && rows[1] != NULL && filtered != NULL &&
+             pixels__deflate_init(&z, pixels__png_band_emit, band, band->max_chain);
+  if (band->ok) {
+    bool last = band->y1 == cnv->height;
+    pixels__deflate_block(&z, last);
+    // First row of the band still filters against the last row of the previous one
+    const Pixels_Rgba *prev = rows[0];
+    if (band->y0 == 0) memset(rows[0], 0, row_size);
+    else if (direct) prev = pixels_get_pixel(cnv, 0, band->y0 - 1);
+    else pixels__canvas_straight_row(cnv, band->y0 - 1, rows[0]);
+    for (int y = band->y0; y < band->y1; ++y) {
+      const Pixels_Rgba *row = rows[(y - band->y0 + 1) & 1];
+      if (direct) row = pixels_get_pixel(cnv, 0, y);
+      else pixels__canvas_straight_row(cnv, y, (Pixels_Rgba*)row);
+      pixels__png_filter_row(filtered, (const unsigned char*)row, (const unsigned char*)prev, row_size);
+      pixels__deflate_feed(&z, filtered, row_size + 1);
+      prev = row;
+    }
+    pixels__deflate_flush(&z, last);
+    pixels__deflate_drain(&z);
+    band->adler = z.adler;
+    band->ok = !z.failed;
+  }
+
+  pixels_temp_rewind(checkpoint);
+  if (band->scratch != NULL) pixels_set_temp_arena(saved);
+  return NULL;
+}
+
+// Bands are encoded into a ring of slots so only a few of them are held at once, band i goes in slot i % slot_count
+typedef struct {
+  const Pixels_Canvas *cnv;
+  Pixels__Png_Band *slots;
+  int slot_count;
+  size_t band_count, band_rows;
+#ifdef PIXELS_PTHREADS
+  // Next band to claim, workers pull from it until it runs past band_count
+  _Atomic size_t next;
+  // Bands written out so far, only the caller moves it
+  size_t emitted;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t band_done, slot_free;
+#endif // PIXELS_PTHREADS
+} Pixels__Png_Pool;
+
+static Pixels__Png_Band *pixels__png_run_band(Pixels__Png_Pool *pool, size_t index, Pixels_Arena *scratch) {
+  Pixels__Png_Band *band = &pool->slots[index % pool->slot_count];
+  band->y0 = (int)(index*pool->band_rows);
+  band->y1 = (int)PIXELS_MIN((index + 1)*pool->band_rows, (size_t)pool->cnv->height);
+  band->scratch = scratch;
+  pixels__png_band_job(band);
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&pool->lock);
+  band->done = index + 1;
+  pthread_cond_broadcast(&pool->band_done);
+  pthread_mutex_unlock(&pool->lock);
+#else
+  band->done = index + 1;
+#endif // PIXELS_PTHREADS
+  return band;
+}
+
+// Bands go out in order, one IDAT chunk each, so the file is the same for any thread count
+static bool pixels__png_emit_band(Pixels_Png_Writer *png, const Pixels__Png_Band *band, uint32_t *adler, size_t row_size) {
+  *adler = pixels__adler32_combine(*adler, band->adler, (size_t)(band->y1 - band->y0)*row_size);
+  return band->ok && pixels__png_chunk(png, "IDAT", band->data, band->size);
+}
+
+#ifdef PIXELS_PTHREADS
+typedef struct {
+  Pixels__Png_Pool *pool;
+  Pixels_Arena scratch;
+} Pixels__Png_Worker;
+
+static void *pixels__png_worker(void *arg) {
+  Pixels__Png_Worker *worker = arg;
+  Pixels__Png_Pool *pool = worker->pool;
+  for (;;) {
+    size_t index = atomic_fetch_add(&pool->next, 1);
+    if (index >= pool->band_count) break;
+    // The slot still holds band index - slot_count until the caller wrote it out
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop && index >= pool->emitted + pool->slot_count) pthread_cond_wait(&pool->slot_free, &pool->lock);
+    bool stop = pool->stop;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) break;
+    pixels__png_run_band(pool, index, &worker->scratch);
+  }
+  return NULL;
+}
+#endif // PIXELS_PTHREADS
+
+bool pixels_encode_png_opt(const Pixels_Canvas *cnv, Pixels_Write_Fn write, void *user, Pixels_Png_Opt opt) {
+  if (cnv->width <= 0 || cnv->height <= 0) return false;
+  size_t band_rows = pixels_png_band_rows(cnv->width);
+  size_t band_count = ((size_t)cnv->height + band_rows - 1) / band_rows;
+  size_t row_size = 1 + (size_t)cnv->width*4;
+  int threads = 1;
+#ifdef PIXELS_PTHREADS
+  threads = opt.threads > 0 ? opt.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif // PIXELS_PTHREADS
+  threads = PIXELS_CLAMP(threads, 1, (int)PIXELS_MIN(band_count, (size_t)PIXELS_PNG_MAX_THREADS));
+
+  // Two slots per thread so a thread that finished a band can start on the next one while the caller writes
+  Pixels__Png_Band slots[2*PIXELS_PNG_MAX_THREADS] = {0};
+  Pixels__Png_Pool pool = {
+    .cnv = cnv,
+    .slots = slots,
+    .slot_count = (int)PIXELS_MIN(2*(size_t)threads, band_count),
+    .band_count = band_count,
+    .band_rows = band_rows,
+  };
+  size_t capacity = pixels__deflate_bound(band_rows*row_size);
+  bool ok = true;
+  for (int s = 0; s < pool.slot_count; ++s) {
+    slots[s].cnv = cnv;
+    slots[s].max_chain = opt.fast ? 0 : PIXELS__PNG_MAX_CHAIN;
+    slots[s].capacity = capacity;
+    slots[s].data = PIXELS_MALLOC(capacity);
+    ok = ok && slots[s].data != NULL;
+  }
+
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  unsigned char ihdr[13];
+  pixels__put_be32(ihdr, cnv->width);
+  pixels__put_be32(ihdr + 4, cnv->height);
+  ihdr[8] = 8;
+  ihdr[9] = 6;
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  Pixels_Png_Writer png = { .write = write, .user = user };
+  pixels__init_deflate_tables();
+  ok = ok && write(user, signature, sizeof(signature)) && pixels__png_chunk(&png, "IHDR", ihdr, sizeof(ihdr));
+  static const unsigned char zlib_header[2] = { 0x78, 0x01 };
+  ok = ok && pixels__png_chunk(&png, "IDAT", zlib_header, sizeof(zlib_header));
+
+  uint32_t adler = 1;
+#ifdef PIXELS_PTHREADS
+  // The workers start once and pull bands until there are none left, the caller encodes bands too whenever
+  // the next one to write out isn't ready yet
+  Pixels__Png_Worker workers[PIXELS_PNG_MAX_THREADS];
+  pthread_t worker_threads[PIXELS_PNG_MAX_THREADS];
+  int worker_count = 0;
+  size_t scratch_size = 2*PIXELS_DEFLATE_WINDOW + (sizeof(int32_t) << PIXELS_DEFLATE_HASH_BITS) + sizeof(int32_t)*PIXELS_DEFLATE_WINDOW +
+                        PIXELS_PNG_CHUNK_SIZE + 3*row_size + 8*PIXELS_ARENA_ALIGNMENT;
+  atomic_init(&pool.next, 0);
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.band_done, NULL);
+  pthread_cond_init(&pool.slot_free, NULL);
+  for (int t = 1; t < threads && ok; ++t) {
+    Pixels__Png_Worker *worker = &workers[worker_count];
+    worker->pool = &pool;
+    worker->scratch = pixels_create_arena(scratch_size);
+    if (worker->scratch.data == NULL) break;
+    if (pthread_create(&worker_threads[worker_count], NULL, pixels__png_worker, worker) != 0) {
+      pixels_destroy_arena(&worker->scratch);
+      break;
+    }
+    worker_count += 1;
+  }
+
+  while (ok && pool.emitted < band_count) {
+    Pixels__Png_Band *band = &slots[pool.emitted % pool.slot_count];
+    pthread_mutex_lock(&pool.lock);
+    bool ready = band->done == pool.emitted + 1;
+    pthread_mutex_unlock(&pool.lock);
+    if (!ready) {
+      // Claim a band with a free slot, and if there's none the next band to write is already being encoded
+      size_t index = atomic_load(&pool.next);
+      size_t limit = PIXELS_MIN(band_count, pool.emitted + pool.slot_count);
+      if (index < limit) {
+        if (atomic_compare_exchange_weak(&pool.next, &index, index + 1)) pixels__png_run_band(&pool, index, NULL);
+        continue;
+      }
+      pthread_mutex_lock(&pool.lock);
+      while (band->done != pool.emitted + 1) pthread_cond_wait(&pool.band_done, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+    }
+    ok = pixels__png_emit_band(&png, band, &adler, row_size);
+    pthread_mutex_lock(&pool.lock);
+    pool.emitted += 1;
+    pthread_cond_broadcast(&pool.slot_free);
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.stop = true;
+  pthread_cond_broadcast(&pool.slot_free);
+  pthread_mutex_unlock(&pool.lock);
+  for (int t = 0; t < worker_count; ++t) {
+    pthread_join(worker_threads[t], NULL);
+    pixels_destroy_arena(&workers[t].scratch);
+  }
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.band_done);
+  pthread_cond_destroy(&pool.slot_free);
+#else
+  for (size_t index = 0; index < band_count && ok; ++index) {
+    ok = pixels__png_emit_band(&png, pixels__png_run_band(&pool, index, NULL), &adler, row_size);
+  }
+#endif // PIXELS_PTHREADS
+
+  unsigned char trailer[4];
+  pixels__put_be32(trailer, adler);
+  ok = ok && pixels__png_chunk(&png, "IDAT", trailer, sizeof(trailer)) && pixels__png_chunk(&png, "IEND", NULL, 0);
+
+  for (int s = 0; s < pool.slot_count; ++s) PIXELS_FREE(slots[s].data);
+  return ok;
+}
+
+bool pixels_write_png(const char *path, const Pixels_Canvas *cnv) {
+#ifdef PIXELS_POSIX
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = pixels_encode_png(cnv, pixels__write_fd, (void*)(intptr_t)fd);
+  return close(fd) == 0 && ok;
+#else
+  (void)path;
+  (void)cnv;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+size_t pixels_png_max_size(int width, int height) {
+  if (width <= 0 || height <= 0) return 0;
+  size_t raw = (1 + (size_t)width*4) * height;
+  // zlib header and adler around the deflate stream
+  size_t zlib = 2 + pixels__deflate_bound(raw) + 4;
+  // Every IDAT but the last one carries at least PIXELS_PNG_CHUNK_SIZE - 3 bytes
+  size_t chunks = zlib/(PIXELS_PNG_CHUNK_SIZE - 3) + 1;
+  // Signature, IHDR, the IDAT framing and IEND
+  return 8 + 25 + 12*chunks + zlib + 12;
+}
+
+bool pixels_encode_png_to_buffer(const Pixels_Canvas *cnv, void *buffer, size_t capacity, size_t *len) {
+  *len = 0;
+  if (cnv->width <= 0 || cnv->height <= 0) return false;
+  Pixels__Buffer_Sink sink = { buffer, 0, capacity };
+  Pixels_Png_Writer png;
+  bool ok = pixels_png_init_to_func(&png, pixels__write_buffer, &sink, cnv->width, cnv->height);
+  ok = ok && pixels_png_write_canvas(&png, cnv);
+  ok = pixels_png_finish(&png) && ok;
+  *len = ok ? sink.size : 0;
+  return ok;
+}
+
+#define PIXELS__QOI_OP_INDEX 0x00
+#define PIXELS__QOI_OP_DIFF  0x40
+#define PIXELS__QOI_OP_LUMA  0x80
+#define PIXELS__QOI_OP_RUN   0xC0
+#define PIXELS__QOI_OP_RGB   0xFE
+#define PIXELS__QOI_OP_RGBA  0xFF
+#define PIXELS__QOI_MASK     0xC0
+
+static inline int pixels__qoi_hash(Pixels_Rgba c) {
+  return (c.red*3 + c.green*5 + c.blue*7 + c.alpha*11) & 63;
+}
+
+static inline bool pixels__rgba_equal(Pixels_Rgba a, Pixels_Rgba b) {
+  uint32_t x, y;
+  memcpy(&x, &a, 4);
+  memcpy(&y, &b, 4);
+  return x == y;
+}
+
+// Encodes one row of pixels into out, which has room for 5 bytes per pixel and a pending run. Returns the bytes written.
+static size_t pixels__qoi_encode_row(unsigned char *out, const Pixels_Rgba *row, int width, Pixels_Rgba *index, Pixels_Rgba *prev_color, int *run) {
+  unsigned char *p = out;
+  Pixels_Rgba prev = *prev_color;
+  for (int x = 0; x < width; ++x) {
+    Pixels_Rgba px = row[x];
+    if (pixels__rgba_equal(px, prev)) {
+      if (++*run == 62) {
+        *p++ = PIXELS__QOI_OP_RUN | (*run - 1);
+        *run = 0;
+      }
+      continue;
+    }
+    if (*run > 0) {
+      *p++ = PIXELS__QOI_OP_RUN | (*run - 1);
+      *run = 0;
+    }
+    int hash = pixels__qoi_hash(px);
+    if (pixels__rgba_equal(index[hash], px)) {
+      *p++ = PIXELS__QOI_OP_INDEX | hash;
+    } else {
+      index[hash] = px;
+      if (px.alpha == prev.alpha) {
+        signed char dr = px.red - prev.red, dg = px.green - prev.green, db = px.blue - prev.blue;
+        signed char dr_dg = dr - dg, db_dg = db - dg;
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+          *p++ = PIXELS__QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+        } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+          *p++ = PIXELS__QOI_OP_LUMA | (dg + 32);
+          *p++ = (dr_dg + 8) << 4 | (db_dg + 8);
+        } else {
+          *p++ = PIXELS__QOI_OP_RGB;
+          *p++ = px.red;
+          *p++ = px.green;
+          *p++ = px.blue;
+        }
+      } else {
+        *p++ = PIXELS__QOI_OP_RGBA;
+        memcpy(p, &px, 4);
+        p += 4;
+      }
+    }
+    prev = px;
+  }
+  *prev_color = prev;
+  return p - out;
+}
+
+static void pixels__qoi_header(unsigned char *out, int width, int height) {
+  memcpy(out, "qoif", 4);
+  pixels__put_be32(out + 4, width);
+  pixels__put_be32(out + 8, height);
+  out[12] = 4; // RGBA
+  out[13] = 0; // sRGB with linear alpha
+}
+
+static const unsigned char pixels__qoi_end[PIXELS_QOI_END_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+bool pixels_encode_qoi(const Pixels_Canvas *cnv, Pixels_Write_Fn write, void *user) {
+  if (cnv->width <= 0 || cnv->height <= 0) return false;
+  size_t checkpoint = pixels_temp_save();
+  // Chunks hold at least one worst case row so a row never has to be split
+  size_t row_bound = (size_t)cnv->width*5 + 2;
+  size_t capacity = PIXELS_MAX((size_t)PIXELS_PNG_CHUNK_SIZE, row_bound + PIXELS_QOI_HEADER_SIZE);
+  unsigned char *chunk = pixels_temp_alloc(capacity);
+  bool direct = cnv->tile_shift == 0 && !(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED);
+  Pixels_Rgba *row = direct ? NULL : pixels_temp_alloc(sizeof(Pixels_Rgba)*cnv->width);
+  bool ok = chunk != NULL && (direct || row != NULL);
+
+  Pixels_Rgba index[64] = {0};
+  Pixels_Rgba prev = { 0, 0, 0, 255 };
+  int run = 0;
+  size_t size = PIXELS_QOI_HEADER_SIZE;
+  if (ok) pixels__qoi_header(chunk, cnv->width, cnv->height);
+  for (int y = 0; y < cnv->height && ok; ++y) {
+    if (size + row_bound > capacity) {
+      ok = write(user, chunk, size);
+      size = 0;
+    }
+    const Pixels_Rgba *pixels = row;
+    if (direct) pixels = pixels_get_pixel(cnv, 0, y);
+    else pixels__canvas_straight_row(cnv, y, row);
+    size += pixels__qoi_encode_row(chunk + size, pixels, cnv->width, index, &prev, &run);
+  }
+  if (ok) {
+    // Runs carry over between rows, the last one still has to go out
+    if (run > 0) chunk[size++] = PIXELS__QOI_OP_RUN | (run - 1);
+    ok = write(user, chunk, size) && write(user, pixels__qoi_end, sizeof(pixels__qoi_end));
+  }
+  pixels_temp_rewind(checkpoint);
+  return ok;
+}
+
+bool pixels_write_qoi(const char *path, const Pixels_Canvas *cnv) {
+#ifdef PIXELS_POSIX
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = pixels_encode_qoi(cnv, pixels__write_fd, (void*)(intptr_t)fd);
+  return close(fd) == 0 && ok;
+#else
+  (void)path;
+  (void)cnv;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+size_t pixels_qoi_max_size(int width, int height) {
+  if (width <= 0 || height <= 0) return 0;
+  // QOI_OP_RGBA is the worst a pixel can get
+  return PIXELS_QOI_HEADER_SIZE + (size_t)width*height*5 + PIXELS_QOI_END_SIZE;
+}
+
+bool pixels_encode_qoi_to_buffer(const Pixels_Canvas *cnv, void *buffer, size_t capacity, size_t *len) {
+  *len = 0;
+  if (cnv->width <= 0 || cnv->height <= 0) return false;
+  Pixels__Buffer_Sink sink = { buffer, 0, capacity };
+  bool ok = pixels_encode_qoi(cnv, pixels__write_buffer, &sink);
+  *len = ok ? sink.size : 0;
+  return ok;
+}
+
+static uint32_t pixels__get_be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+Pixels_Canvas pixels_decode_qoi(const void *data, size_t size) {
+  Pixels_Canvas cnv = {0};
+  const unsigned char *bytes = data;
+  if (size < PIXELS_QOI_HEADER_SIZE + PIXELS_QOI_END_SIZE || memcmp(bytes, "qoif", 4) != 0) return cnv;
+  uint32_t width = pixels__get_be32(bytes + 4), height = pixels__get_be32(bytes + 8);
+  if (width == 0 || height == 0 || height > PIXELS_QOI_PIXELS_MAX/width || bytes[12] < 3 || bytes[12] > 4) return cnv;
+  if (memcmp(bytes + size - PIXELS_QOI_END_SIZE, pixels__qoi_end, PIXELS_QOI_END_SIZE) != 0) return cnv;
+  cnv = pixels_create_canvas((int)width, (int)height);
+  if (cnv.pixels == NULL) return cnv;
+
+  Pixels_Rgba index[64] = {0};
+  Pixels_Rgba px = { 0, 0, 0, 255 };
+  size_t p = PIXELS_QOI_HEADER_SIZE, end = size - PIXELS_QOI_END_SIZE;
+  int run = 0;
+  bool truncated = false;
+  for (size_t i = 0; i < cnv.count; ++i) {
+    if (run > 0) {
+      --run;
+    } else if (p < end) {
+      int b1 = bytes[p++];
+      if (b1 == PIXELS__QOI_OP_RGB) {
+        if (p + 3 > end) { truncated = true; break; }
+        px.red = bytes[p];
+        px.green = bytes[p + 1];
+        px.blue = bytes[p + 2];
+        p += 3;
+      } else if (b1 == PIXELS__QOI_OP_RGBA) {
+        if (p + 4 > end) { truncated = true; break; }
+        memcpy(&px, bytes + p, 4);
+        p += 4;
+      } else if ((b1 & PIXELS__QOI_MASK) == PIXELS__QOI_OP_INDEX) {
+        px = index[b1];
+      } else if ((b1 & PIXELS__QOI_MASK) == PIXELS__QOI_OP_DIFF) {
+        px.red += ((b1 >> 4) & 3) - 2;
+        px.green += ((b1 >> 2) & 3) - 2;
+        px.blue += (b1 & 3) - 2;
+      } else if ((b1 & PIXELS__QOI_MASK) == PIXELS__QOI_OP_LUMA) {
+        if (p + 1 > end) { truncated = true; break; }
+        int b2 = bytes[p++];
+        int dg = (b1 & 0x3F) - 32;
+        px.red += dg - 8 + ((b2 >> 4) & 0x0F);
+        px.green += dg;
+        px.blue += dg - 8 + (b2 & 0x0F);
+      } else {
+        run = b1 & 0x3F;
+      }
+      index[pixels__qoi_hash(px)] = px;
+    } else {
+      truncated = true;
+      break;
+    }
+    cnv.pixels[i] = px;
+  }
+  // Ran out of data before every pixel got a value
+  if (truncated) pixels_destroy_canvas(&cnv);
+  return cnv;
+}
+
+Pixels_Canvas pixels_read_qoi(const char *path) {
+  Pixels_Canvas cnv = {0};
+#ifdef PIXELS_POSIX
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return cnv;
+  off_t size = lseek(fd, 0, SEEK_END);
+  unsigned char *data = size > 0 ? PIXELS_MALLOC(size) : NULL;
+  size_t got = 0;
+  if (data != NULL && lseek(fd, 0, SEEK_SET) == 0) {
+    while (got < (size_t)size) {
+      ssize_t n = read(fd, data + got, size - got);
+      if (n <= 0) break;
+      got += n;
+    }
+  }
+  close(fd);
+  if (data != NULL && got == (size_t)size) cnv = pixels_decode_qoi(data, got);
+  PIXELS_FREE(data);
+#else
+  (void)path;
+#endif // PIXELS_POSIX
+  return cnv;
+}
+
+static inline unsigned char pixels__rgb_to_y(int r, int g, int b) {
+  return (77*r + 150*g + 29*b + 128) >> 8;
+}
+
+// r, g and b are sums of four pixels
+static inline void pixels__rgb_to_uv(int r, int g, int b, unsigned char *u, unsigned char *v) {
+  r = (r + 2) >> 2;
+  g = (g + 2) >> 2;
+  b = (b + 2) >> 2;
+  int cb = (-43*r - 85*g + 128*b + 32896) >> 8;
+  int cr = (128*r - 107*g - 21*b + 32896) >> 8;
+  *u = PIXELS_MIN(cb, 255);
+  *v = PIXELS_MIN(cr, 255);
+}
+
+#ifdef PIXELS_SSE2
+// Sums lanes 0+1 and 2+3 of a and b, giving [a0+a1, a2+a3, b0+b1, b2+b3]
+static inline __m128i pixels__sse2_pair_sums(__m128i a, __m128i b) {
+  __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+  __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+  return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+// Luma of 4 pixels as 32 bit lanes
+static inline __m128i pixels__sse2_luma4(__m128i px) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i coefs = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coefs);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coefs);
+  return _mm_srli_epi32(_mm_add_epi32(pixels__sse2_pair_sums(lo, hi), _mm_set1_epi32(128)), 8);
+}
+
+// 2x2 block averages of 4 pixels from each row as [block0 rgba, block1 rgba] in 16 bit lanes
+static inline __m128i pixels__sse2_block_avg(__m128i top, __m128i bottom) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+  __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+  lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+  hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+  __m128i sums = _mm_unpacklo_epi64(lo, hi);
+  return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+// One chroma channel for 4 blocks, clamped and packed into the low 4 bytes
+static inline int32_t pixels__sse2_chroma4(__m128i blocks01, __m128i blocks23, __m128i coefs) {
+  const __m128i bias = _mm_set1_epi32(32896);
+  __m128i c = pixels__sse2_pair_sums(_mm_madd_epi16(blocks01, coefs), _mm_madd_epi16(blocks23, coefs));
+  c = _mm_srai_epi32(_mm_add_epi32(c, bias), 8);
+  c = _mm_packs_epi32(c, c);
+  return _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+}
+#endif // PIXELS_SSE2
+
+void pixels_rgba_to_yuv420_rows(const Pixels_Rgba *row0, const Pixels_Rgba *row1, int width, unsigned char *y0, unsigned char *y1, unsigned char *u, unsigned char *v) {
+  int x = 0;
+#ifdef PIXELS_SSE2
+  const __m128i cb_coefs = _mm_setr_epi16(-43, -85, 128, 0, -43, -85, 128, 0);
+  const __m128i cr_coefs = _mm_setr_epi16(128, -107, -21, 0, 128, -107, -21, 0);
+  for (; x + 8 <= width; x += 8) {
+    __m128i t0 = _mm_loadu_si128((const __m128i*)(row0 + x));
+    __m128i t1 = _mm_loadu_si128((const __m128i*)(row0 + x + 4));
+    __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x));
+    __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x + 4));
+
+    __m128i luma_top = _mm_packs_epi32(pixels__sse2_luma4(t0), pixels__sse2_luma4(t1));
+    __m128i luma_bottom = _mm_packs_epi32(pixels__sse2_luma4(b0), pixels__sse2_luma4(b1));
+    _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(luma_top, luma_top));
+    _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(luma_bottom, luma_bottom));
+
+    __m128i blocks01 = pixels__sse2_block_avg(t0, b0);
+    __m128i blocks23 = pixels__sse2_block_avg(t1, b1);
+    int32_t cb = pixels__sse2_chroma4(blocks01, blocks23, cb_coefs);
+    int32_t cr = pixels__sse2_chroma4(blocks01, blocks23, cr_coefs);
+    memcpy(u + x/2, &cb, 4);
+    memcpy(v + x/2, &cr, 4);
+  }
+#endif // PIXELS_SSE2
+  for (; x < width; x += 2) {
+    // Odd widths reuse the last column for the missing half of the block
+    int x1 = PIXELS_MIN(x + 1, width - 1);
+    Pixels_Rgba p[4] = { row0[x], row0[x1], row1[x], row1[x1] };
+    y0[x] = pixels__rgb_to_y(p[0].red, p[0].green, p[0].blue);
+    y1[x] = pixels__rgb_to_y(p[2].red, p[2].green, p[2].blue);
+    if (x + 1 < width) {
+      y0[x + 1] = pixels__rgb_to_y(p[1].red, p[1].green, p[1].blue);
+      y1[x + 1] = pixels__rgb_to_y(p[3].red, p[3].green, p[3].blue);
+    }
+    pixels__rgb_to_uv(p[0].red + p[1].red + p[2].red + p[3].red,
+                      p[0].green + p[1].green + p[2].green + p[3].green,
+                      p[0].blue + p[1].blue + p[2].blue + p[3].blue, u + x/2, v + x/2);
+  }
+}
+
+#ifdef PIXELS_POSIX
+// Keeps calling writev until everything went out, pipes are happy to take partial writes
+static bool pixels__writev_all(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, count);
+    if (n < 0) return false;
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (unsigned char*)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+// Most systems take at least this many buffers in a writev
+#define PIXELS__IOV_BATCH 512
+#endif // PIXELS_POSIX
+
+bool pixels_video_sink_open_opt(Pixels_Video_Sink *sink, int fd, int width, int height, Pixels_Video_Opt opt) {
+  memset(sink, 0, sizeof(*sink));
+  sink->fd = fd;
+  sink->width = width;
+  sink->height = height;
+  if (opt.fps_num <= 0) opt.fps_num = 30;
+  if (opt.fps_den <= 0) opt.fps_den = 1;
+  sink->opt = opt;
+#ifdef PIXELS_POSIX
+  size_t chroma = (size_t)((width + 1)/2) * ((height + 1)/2);
+  size_t scratch_size = opt.format == PIXELS_VIDEO_Y4M
+    ? (size_t)width*height + 2*chroma
+    : (size_t)width*4*PIXELS_VIDEO_BAND_ROWS;
+  sink->scratch = PIXELS_MALLOC(scratch_size);
+  if (sink->scratch == NULL) {
+    sink->failed = true;
+    return false;
+  }
+  if (opt.format == PIXELS_VIDEO_Y4M) {
+    char header[128];
+    int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, opt.fps_num, opt.fps_den);
+    struct iovec iov = { header, (size_t)n };
+    sink->failed = !pixels__writev_all(fd, &iov, 1);
+  }
+#else
+  sink->failed = true;
+#endif // PIXELS_POSIX
+  return !sink->failed;
+}
+
+#ifdef PIXELS_POSIX
+static bool pixels__video_write_y4m(Pixels_Video_Sink *sink, const Pixels_Canvas *cnv, bool direct) {
+  int width = cnv->width, height = cnv->height;
+  size_t chroma_width = (width + 1)/2;
+  unsigned char *y_plane = sink->scratch;
+  unsigned char *u_plane = y_plane + (size_t)width*height;
+  unsigned char *v_plane = u_plane + chroma_width*((height + 1)/2);
+
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgba *rows[2] = {0};
+  if (!direct) {
+    rows[0] = pixels_temp_alloc(sizeof(Pixels_Rgba)*width);
+    rows[1] = pixels_temp_alloc(sizeof(Pixels_Rgba)*width);
+    if (rows[0] == NULL || rows[1] == NULL) return false;
+  }
+  for (int y = 0; y < height; y += 2) {
+    int y1 = PIXELS_MIN(y + 1, height - 1);
+    const Pixels_Rgba *top = rows[0], *bottom = rows[1];
+    if (direct) {
+      top = pixels_get_pixel(cnv, 0, y);
+      bottom = pixels_get_pixel(cnv, 0, y1);
+    } else {
+      pixels__canvas_straight_row(cnv, y, rows[0]);
+      pixels__canvas_straight_row(cnv, y1, rows[1]);
+    }
+    // The bottom luma row of an odd height lands on the top one, both come out the same anyway
+    pixels_rgba_to_yuv420_rows(top, bottom, width, y_plane + (size_t)y*width, y_plane + (size_t)y1*width,
+                               u_plane + (y/2)*chroma_width, v_plane + (y/2)*chroma_width);
+  }
+  pixels_temp_rewind(checkpoint);
+
+  size_t chroma_size = chroma_width*((height + 1)/2);
+  struct iovec iov[4] = {
+    { "FRAME\n", 6 },
+    { y_plane, (size_t)width*height },
+    { u_plane, chroma_size },
+    { v_plane, chroma_size },
+  };
+  return pixels__writev_all(sink->fd, iov, 4);
+}
+
+static void pixels__rgba_to_rgb(unsigned char *out, const Pixels_Rgba *in, size_t count) {
+  size_t i = 0;
+#ifdef PIXELS_SSSE3
+  // 4 pixels in, 12 bytes out, stores overlap by 4 bytes and the next one fixes them up
+  const __m128i drop_alpha = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  for (; i + 6 <= count; i += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i*)(in + i));
+    _mm_storeu_si128((__m128i*)(out + i*3), _mm_shuffle_epi8(px, drop_alpha));
+  }
+#endif // PIXELS_SSSE3
+  for (; i < count; ++i) {
+    out[i*3] = in[i].red;
+    out[i*3 + 1] = in[i].green;
+    out[i*3 + 2] = in[i].blue;
+  }
+}
+
+static bool pixels__video_write_packed(Pixels_Video_Sink *sink, const Pixels_Canvas *cnv, bool direct) {
+  int width = cnv->width;
+  struct iovec iov[PIXELS__IOV_BATCH];
+  int count = 0;
+  char header[64];
+  if (sink->opt.format == PIXELS_VIDEO_PPM) {
+    int n = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, cnv->height);
+    iov[count++] = (struct iovec) { header, (size_t)n };
+  }
+  // Raw RGBA of a plain canvas goes out straight from the pixels
+  if (direct && sink->opt.format == PIXELS_VIDEO_RGBA) {
+    for (int y = 0; y < cnv->height; ++y) {
+      iov[count++] = (struct iovec) { pixels_get_pixel(cnv, 0, y), sizeof(Pixels_Rgba)*width };
+      if (count == PIXELS__IOV_BATCH) {
+        if (!pixels__writev_all(sink->fd, iov, count)) return false;
+        count = 0;
+      }
+    }
+    return pixels__writev_all(sink->fd, iov, count);
+  }
+
+  size_t pixel_size = sink->opt.format == PIXELS_VIDEO_PPM ? 3 : 4;
+  size_t checkpoint = pixels_temp_save();
+  Pixels_Rgba *row = pixels_temp_alloc(sizeof(Pixels_Rgba)*width);
+  if (row == NULL) return false;
+  bool ok = true;
+  for (int y0 = 0; y0 < cnv->height && ok; y0 += PIXELS_VIDEO_BAND_ROWS) {
+    int rows = PIXELS_MIN(PIXELS_VIDEO_BAND_ROWS, cnv->height - y0);
+    for (int i = 0; i < rows; ++i) {
+      unsigned char *out = sink->scratch + (size_t)i*width*pixel_size;
+      const Pixels_Rgba *src = row;
+      if (direct) src = pixels_get_pixel(cnv, 0, y0 + i);
+      else pixels__canvas_straight_row(cnv, y0 + i, row);
+      if (pixel_size == 3) pixels__rgba_to_rgb(out, src, width);
+      else memcpy(out, src, sizeof(Pixels_Rgba)*width);
+      iov[count++] = (struct iovec) { out, width*pixel_size };
+    }
+    ok = pixels__writev_all(sink->fd, iov, count);
+    count = 0;
+  }
+  pixels_temp_rewind(checkpoint);
+  return ok;
+}
+#endif // PIXELS_POSIX
+
+bool pixels_video_sink_write(Pixels_Video_Sink *sink, const Pixels_Canvas *cnv) {
+  if (sink->failed || cnv->width != sink->width || cnv->height != sink->height) {
+    sink->failed = true;
+    return false;
+  }
+#ifdef PIXELS_POSIX
+  bool direct = cnv->tile_shift == 0 && !(cnv->flags & PIXELS_CANVAS_PREMULTIPLIED);
+  bool ok = sink->opt.format == PIXELS_VIDEO_Y4M
+    ? pixels__video_write_y4m(sink, cnv, direct)
+    : pixels__video_write_packed(sink, cnv, direct);
+  sink->failed = !ok;
+  sink->frames += ok;
+  return ok;
+#else
+  return false;
+#endif // PIXELS_POSIX
+}
+
+bool pixels_video_sink_close(Pixels_Video_Sink *sink) {
+  PIXELS_FREE(sink->scratch);
+  sink->scratch = NULL;
+  return !sink->failed;
+}
+
+// Random words from splitmix64, the first 16 are the per stripe keys and the rest scramble and merge
+static const uint64_t pixels__hash_secret[24] = {
+  0xC9FE5B730C613C03ULL, 0x5F189F7BFDE7BE72ULL, 0x7406C8FB4DF61C20ULL, 0xF9E3DD2F157F3F62ULL,
+  0x3BF6C7CAA3C1B03EULL, 0xC4A8B5E85C6816A5ULL, 0xFF378128EB73E6D5ULL, 0x2D6FD609CBF16CA7ULL,
+  0x4BE07C279D070FA2ULL, 0x5DA99C945309A364ULL, 0x9AF18F18417DF3B1ULL, 0x7DD3D92F8658C04BULL,
+  0x96A9F559D03216C3ULL, 0x64BD61F7133EBF50ULL, 0x2962C1D8FD1260D4ULL, 0xCB13FF654A9F2AA7ULL,
+  0x28B55462C4180DDEULL, 0xA700864016F67B1EULL, 0xDC385B40C83A1B68ULL, 0x065EDD563111A981ULL,
+  0xE1FBFFAEC40849D5ULL, 0x8B19FBD095450F79ULL, 0x853555FFE37C3623ULL, 0xD3A093F889214308ULL,
+};
+
+#define PIXELS__HASH_STRIPE 64
+#define PIXELS__HASH_STRIPES_PER_BLOCK 16
+#define PIXELS__PRIME32_1 0x9E3779B1u
+#define PIXELS__PRIME64_1 0x9E3779B185EBCA87ULL
+
+static inline uint64_t pixels__read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Stripe n uses the key window starting at key[n]. Each lane adds the product of the low and high halves
+// of data^key, and its neighbour gets the plain data.
+static void pixels__hash_stripes(uint64_t acc[8], const unsigned char *p, int stripes, const uint64_t *key) {
+#ifdef PIXELS_SSE2
+  // Accumulators stay in registers for the whole run of stripes
+  __m128i a[4];
+  for (int i = 0; i < 4; ++i) a[i] = _mm_loadu_si128((const __m128i*)(acc + 2*i));
+  for (int n = 0; n < stripes; ++n, p += PIXELS__HASH_STRIPE) {
+    for (int i = 0; i < 4; ++i) {
+      __m128i data = _mm_loadu_si128((const __m128i*)(p + 16*i));
+      __m128i data_key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + n + 2*i)));
+      __m128i product = _mm_mul_epu32(data_key, _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+      __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+    }
+  }
+  for (int i = 0; i < 4; ++i) _mm_storeu_si128((__m128i*)(acc + 2*i), a[i]);
+#else
+  for (int n = 0; n < stripes; ++n, p += PIXELS__HASH_STRIPE) {
+    for (int i = 0; i < 8; ++i) {
+      uint64_t data = pixels__read64(p + 8*i);
+      uint64_t data_key = data ^ key[n + i];
+      acc[i ^ 1] += data;
+      acc[i] += (data_key & 0xFFFFFFFFu) * (data_key >> 32);
+    }
+  }
+#endif // PIXELS_SSE2
+}
+
+static inline void pixels__hash_scramble(uint64_t acc[8], const uint64_t *key) {
+  for (int i = 0; i < 8; ++i) {
+    acc[i] ^= acc[i] >> 47;
+    acc[i] ^= key[i];
+    acc[i] *= PIXELS__PRIME32_1;
+  }
+}
+
+static inline uint64_t pixels__mul128_fold64(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+  uint64_t lo_lo = (a & 0xFFFFFFFFu) * (b & 0xFFFFFFFFu);
+  uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFFu);
+  uint64_t lo_hi = (a & 0xFFFFFFFFu) * (b >> 32);
+  uint64_t hi_hi = (a >> 32) * (b >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+  uint64_t hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+  uint64_t lo = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+  return lo ^ hi;
+#endif // __SIZEOF_INT128__
+}
+
+uint64_t pixels_hash(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *p = data;
+  const uint64_t *secret = pixels__hash_secret;
+  uint64_t acc[8] = {
+    0x9E3779B1u, PIXELS__PRIME64_1, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+    0x85EBCA77C2B2AE63ULL, 0x85EBCA77u, 0x27D4EB2F165667C5ULL, 0xC2B2AE3Du,
+  };
+  for (int i = 0; i < 8; ++i) acc[i] ^= seed;
+
+  // Full blocks of 16 stripes, each stripe with its own window of the secret, then a scramble
+  size_t block_size = PIXELS__HASH_STRIPE*PIXELS__HASH_STRIPES_PER_BLOCK;
+  size_t offset = 0;
+  for (; offset + block_size <= size; offset += block_size) {
+    pixels__hash_stripes(acc, p + offset, PIXELS__HASH_STRIPES_PER_BLOCK, secret);
+    pixels__hash_scramble(acc, secret + 16);
+  }
+  int stripes = (int)((size - offset)/PIXELS__HASH_STRIPE);
+  pixels__hash_stripes(acc, p + offset, stripes, secret);
+  offset += (size_t)stripes*PIXELS__HASH_STRIPE;
+  if (offset < size) {
+    // The last partial stripe overlaps the one before it, inputs smaller than a stripe get zero padded
+    unsigned char tail[PIXELS__HASH_STRIPE] = {0};
+    const unsigned char *last = p + size - PIXELS__HASH_STRIPE;
+    if (size < PIXELS__HASH_STRIPE) {
+      memcpy(tail, p, size);
+      last = tail;
+    }
+    pixels__hash_stripes(acc, last, 1, secret + 7);
+  }
+
+  uint64_t h = (uint64_t)size * PIXELS__PRIME64_1;
+  for (int i = 0; i < 4; ++i) h += pixels__mul128_fold64(acc[2*i] ^ secret[16 + 2*i], acc[2*i + 1] ^ secret[17 + 2*i]);
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t pixels_canvas_hash(const Pixels_Canvas *cnv) {
+  uint64_t seed = ((uint64_t)(uint32_t)cnv->width << 32) ^ (uint32_t)cnv->height ^
+                  ((uint64_t)cnv->tile_shift << 24) ^ ((uint64_t)cnv->flags << 28);
+  return pixels_hash(cnv->pixels, sizeof(Pixels_Rgba)*cnv->count, seed);
+}
+
+static bool pixels__write_image(const char *path, const Pixels_Canvas *cnv, Pixels_Image_Format format, bool fast) {
+#ifdef PIXELS_POSIX
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = format == PIXELS_IMAGE_QOI
+    ? pixels_encode_qoi(cnv, pixels__write_fd, (void*)(intptr_t)fd)
+    // The pool already keeps every thread busy with its own frame
+    : pixels_encode_png(cnv, pixels__write_fd, (void*)(intptr_t)fd, .threads = 1, .fast = fast);
+  return close(fd) == 0 && ok;
+#else
+  (void)path;
+  (void)cnv;
+  (void)format;
+  (void)fast;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+// File that repeated frames point at, shared by its job and the writer until both are done with it
+typedef struct {
+  char *path;
+  // Repeats submitted before the file was written, they get linked once it is
+  char **links;
+  int link_count, link_capacity;
+  int refs;
+  bool done, ok;
+} Pixels__Async_Source;
+
+typedef struct {
+  Pixels_Canvas cnv;
+  char *path;
+  // Set when deduplicating, then path belongs to the source
+  Pixels__Async_Source *source;
+} Pixels__Async_Job;
+
+struct Pixels_Async_Writer {
+  int width, height;
+  Pixels_Async_Writer_Opt opt;
+  // Ring of queued frames
+  Pixels__Async_Job *queue;
+  int queue_head, queue_count;
+  // Free canvases, created lazily up to max_canvases
+  Pixels_Canvas *pool;
+  int pool_count, canvases_made, max_canvases;
+  // Frames taken off the queue that are still being written
+  int busy;
+  bool stopping, failed;
+  // Last frame that got encoded when deduplicating
+  uint64_t last_hash;
+  Pixels__Async_Source *last_source;
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready, job_taken, canvas_free, idle;
+  pthread_t threads[PIXELS_ASYNC_MAX_THREADS];
+  int thread_count;
+#endif // PIXELS_PTHREADS
+};
+
+// Called with the lock held
+static void pixels__async_recycle(Pixels_Async_Writer *writer, Pixels_Canvas *cnv) {
+  if (cnv->width == writer->width && cnv->height == writer->height && cnv->tile_shift == 0 &&
+      writer->pool_count < writer->max_canvases) {
+    cnv->flags = 0;
+    writer->pool[writer->pool_count++] = *cnv;
+  } else {
+    pixels_destroy_canvas(cnv);
+  }
+}
+
+static inline void pixels__async_lock(Pixels_Async_Writer *writer) {
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+#else
+  (void)writer;
+#endif // PIXELS_PTHREADS
+}
+
+static inline void pixels__async_unlock(Pixels_Async_Writer *writer) {
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_unlock(&writer->lock);
+#else
+  (void)writer;
+#endif // PIXELS_PTHREADS
+}
+
+static char *pixels__strdup(const char *str) {
+  size_t size = strlen(str) + 1;
+  char *copy = PIXELS_MALLOC(size);
+  if (copy != NULL) memcpy(copy, str, size);
+  return copy;
+}
+
+// Called with the lock held
+static void pixels__async_source_release(Pixels__Async_Source *source) {
+  if (source == NULL || --source->refs > 0) return;
+  for (int i = 0; i < source->link_count; ++i) PIXELS_FREE(source->links[i]);
+  PIXELS_FREE(source->links);
+  PIXELS_FREE(source->path);
+  PIXELS_FREE(source);
+}
+
+static bool pixels__async_link(const char *source, const char *path) {
+#ifdef PIXELS_POSIX
+  // link doesn't replace, frames from an earlier run are in the way
+  unlink(path);
+  return link(source, path) == 0;
+#else
+  (void)source;
+  (void)path;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+static bool pixels__async_marker(const char *source, const char *path) {
+#ifdef PIXELS_POSIX
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = pixels__write_fd((void*)(intptr_t)fd, "repeat ", 7) && pixels__write_fd((void*)(intptr_t)fd, source, strlen(source)) &&
+            pixels__write_fd((void*)(intptr_t)fd, "\n", 1);
+  return close(fd) == 0 && ok;
+#else
+  (void)source;
+  (void)path;
+  return false;
+#endif // PIXELS_POSIX
+}
+
+// Everything after a frame got written: the canvas goes back to the pool and repeats waiting on it get linked
+static void pixels__async_job_done(Pixels_Async_Writer *writer, Pixels__Async_Job *job, bool ok) {
+  Pixels__Async_Source *source = job->source;
+  char **links = NULL;
+  int link_count = 0;
+  pixels__async_lock(writer);
+  writer->failed = writer->failed || !ok;
+  // Batched frames gave their canvas back as soon as they were encoded
+  if (job->cnv.pixels != NULL) pixels__async_recycle(writer, &job->cnv);
+  if (source != NULL) {
+    source->done = true;
+    source->ok = ok;
+    links = source->links;
+    link_count = source->link_count;
+    source->links = NULL;
+    source->link_count = source->link_capacity = 0;
+  } else {
+    PIXELS_FREE(job->path);
+  }
+#ifdef PIXELS_PTHREADS
+  pthread_cond_signal(&writer->canvas_free);
+#endif // PIXELS_PTHREADS
+  pixels__async_unlock(writer);
+
+  bool links_ok = true;
+  for (int i = 0; i < link_count; ++i) {
+    links_ok = ok && pixels__async_link(source->path, links[i]) && links_ok;
+    PIXELS_FREE(links[i]);
+  }
+  PIXELS_FREE(links);
+
+  pixels__async_lock(writer);
+  writer->failed = writer->failed || !links_ok;
+  pixels__async_source_release(source);
+  pixels__async_unlock(writer);
+}
+
+#ifdef PIXELS_PTHREADS
+// Writes out a worker's batch and finishes the frames in it, they stay busy until their files are on disk
+static void pixels__async_flush_staged(Pixels_Async_Writer *writer, Pixels_File_Batch *batch, Pixels__Async_Job *staged, int *staged_count) {
+  bool ok = pixels_file_batch_flush(batch);
+  for (int i = 0; i < *staged_count; ++i) pixels__async_job_done(writer, &staged[i], ok);
+  pthread_mutex_lock(&writer->lock);
+  writer->busy -= *staged_count;
+  if (writer->queue_count == 0 && writer->busy == 0) pthread_cond_broadcast(&writer->idle);
+  pthread_mutex_unlock(&writer->lock);
+  *staged_count = 0;
+}
+
+static void *pixels__async_worker(void *arg) {
+  Pixels_Async_Writer *writer = arg;
+  // Encoder scratch, owned here so it goes away with the thread instead of leaking a thread local arena
+  Pixels_Arena scratch = pixels_create_arena(PIXELS_TEMP_CAPACITY);
+  if (scratch.data != NULL) pixels_set_temp_arena(&scratch);
+  // A batch per thread, without one the frames get written one by one
+  Pixels_File_Batch *batch = writer->opt.batch_files ? pixels_file_batch_create(.files = PIXELS_FILE_BATCH_FILES) : NULL;
+  Pixels__Async_Job staged[PIXELS_FILE_BATCH_FILES];
+  int staged_count = 0;
+  pthread_mutex_lock(&writer->lock);
+  for (;;) {
+    if (staged_count > 0 && (writer->queue_count == 0 || staged_count == PIXELS_FILE_BATCH_FILES)) {
+      pthread_mutex_unlock(&writer->lock);
+      pixels__async_flush_staged(writer, batch, staged, &staged_count);
+      pthread_mutex_lock(&writer->lock);
+      continue;
+    }
+    while (writer->queue_count == 0 && !writer->stopping) pthread_cond_wait(&writer->job_ready, &writer->lock);
+    if (writer->queue_count == 0) break;
+    Pixels__Async_Job job = writer->queue[writer->queue_head];
+    writer->queue_head = (writer->queue_head + 1) % writer->opt.queue_size;
+    writer->queue_count -= 1;
+    writer->busy += 1;
+    pthread_cond_signal(&writer->job_taken);
+    pthread_mutex_unlock(&writer->lock);
+
+    if (batch != NULL) {
+      bool ok = pixels_file_batch_write_image(batch, job.path, &job.cnv, writer->opt.format);
+      if (ok) {
+        // The encoded bytes are in the batch, the canvas can go render the next frame
+        pthread_mutex_lock(&writer->lock);
+        pixels__async_recycle(writer, &job.cnv);
+        pthread_cond_signal(&writer->canvas_free);
+        pthread_mutex_unlock(&writer->lock);
+        memset(&job.cnv, 0, sizeof(job.cnv));
+        staged[staged_count++] = job;
+        pthread_mutex_lock(&writer->lock);
+        continue;
+      }
+      pixels__async_job_done(writer, &job, ok);
+    } else {
+      bool ok = pixels__write_image(job.path, &job.cnv, writer->opt.format, writer->opt.fast);
+      pixels__async_job_done(writer, &job, ok);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->busy -= 1;
+    if (writer->queue_count == 0 && writer->busy == 0) pthread_cond_broadcast(&writer->idle);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  if (batch != NULL) pixels_file_batch_destroy(batch);
+  pixels_set_temp_arena(NULL);
+  pixels_destroy_arena(&scratch);
+  return NULL;
+}
+#endif // PIXELS_PTHREADS
+
+Pixels_Async_Writer *pixels_async_writer_create_opt(int width, int height, Pixels_Async_Writer_Opt opt) {
+  int threads = 0;
+#ifdef PIXELS_PTHREADS
+  threads = opt.threads > 0 ? opt.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  threads = PIXELS_CLAMP(threads, 1, PIXELS_ASYNC_MAX_THREADS);
+#endif // PIXELS_PTHREADS
+  opt.threads = threads;
+  if (opt.queue_size <= 0) opt.queue_size = PIXELS_MAX(2*threads, 1);
+
+  Pixels_Async_Writer *writer = PIXELS_MALLOC(sizeof(*writer));
+  if (writer == NULL) return NULL;
+  memset(writer, 0, sizeof(*writer));
+  writer->width = width;
+  writer->height = height;
+  writer->opt = opt;
+  // Every queued frame, one per encoder and the one being rendered
+  writer->max_canvases = opt.queue_size + threads + 1;
+  writer->queue = PIXELS_MALLOC(sizeof(Pixels__Async_Job)*opt.queue_size);
+  writer->pool = PIXELS_MALLOC(sizeof(Pixels_Canvas)*writer->max_canvases);
+  if (writer->queue == NULL || writer->pool == NULL) {
+    PIXELS_FREE(writer->queue);
+    PIXELS_FREE(writer->pool);
+    PIXELS_FREE(writer);
+    return NULL;
+  }
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->job_ready, NULL);
+  pthread_cond_init(&writer->job_taken, NULL);
+  pthread_cond_init(&writer->canvas_free, NULL);
+  pthread_cond_init(&writer->idle, NULL);
+  for (int t = 0; t < threads; ++t) {
+    if (pthread_create(&writer->threads[writer->thread_count], NULL, pixels__async_worker, writer) == 0) writer->thread_count += 1;
+  }
+#endif // PIXELS_PTHREADS
+  return writer;
+}
+
+bool pixels_async_writer_acquire(Pixels_Async_Writer *writer, Pixels_Canvas *cnv) {
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+  while (writer->thread_count > 0 && writer->pool_count == 0 && writer->canvases_made >= writer->max_canvases) {
+    pthread_cond_wait(&writer->canvas_free, &writer->lock);
+  }
+#endif // PIXELS_PTHREADS
+  bool from_pool = writer->pool_count > 0;
+  if (from_pool) *cnv = writer->pool[--writer->pool_count];
+  else writer->canvases_made += 1;
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_unlock(&writer->lock);
+#endif // PIXELS_PTHREADS
+  if (from_pool) return true;
+
+  *cnv = pixels_create_canvas(writer->width, writer->height);
+  if (cnv->pixels != NULL) return true;
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+#endif // PIXELS_PTHREADS
+  writer->canvases_made -= 1;
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_unlock(&writer->lock);
+#endif // PIXELS_PTHREADS
+  return false;
+}
+
+// Handles a frame that's the same as the last encoded one, with the lock held. False if it's a new frame.
+static bool pixels__async_dedup(Pixels_Async_Writer *writer, Pixels__Async_Job *job, uint64_t hash, bool *ok) {
+  Pixels__Async_Source *source = writer->last_source;
+  if (source == NULL || hash != writer->last_hash) return false;
+  pixels__async_recycle(writer, &job->cnv);
+#ifdef PIXELS_PTHREADS
+  pthread_cond_signal(&writer->canvas_free);
+#endif // PIXELS_PTHREADS
+  // Markers don't need the source to exist yet, links have to wait until it's written
+  if (writer->opt.dedup == PIXELS_DEDUP_MARKER || source->done) {
+    pixels__async_unlock(writer);
+    *ok = writer->opt.dedup == PIXELS_DEDUP_MARKER
+      ? pixels__async_marker(source->path, job->path)
+      : source->ok && pixels__async_link(source->path, job->path);
+    PIXELS_FREE(job->path);
+    pixels__async_lock(writer);
+    writer->failed = writer->failed || !*ok;
+    return true;
+  }
+  if (source->link_count == source->link_capacity) {
+    int capacity = PIXELS_MAX(2*source->link_capacity, 8);
+    char **links = PIXELS_MALLOC(sizeof(char*)*capacity);
+    if (links == NULL) {
+      writer->failed = true;
+      PIXELS_FREE(job->path);
+      *ok = false;
+      return true;
+    }
+    if (source->link_count > 0) memcpy(links, source->links, sizeof(char*)*source->link_count);
+    PIXELS_FREE(source->links);
+    source->links = links;
+    source->link_capacity = capacity;
+  }
+  source->links[source->link_count++] = job->path;
+  *ok = true;
+  return true;
+}
+
+bool pixels_async_writer_submit(Pixels_Async_Writer *writer, Pixels_Canvas *cnv, const char *path) {
+  Pixels__Async_Job job = { .cnv = *cnv, .path = pixels__strdup(path) };
+  memset(cnv, 0, sizeof(*cnv));
+
+  if (writer->opt.dedup != PIXELS_DEDUP_OFF && job.path != NULL) {
+    // Hashing happens here on the caller's thread, it's far cheaper than the encode it might save
+    uint64_t hash = pixels_canvas_hash(&job.cnv);
+    bool ok = true;
+    pixels__async_lock(writer);
+    bool repeat = pixels__async_dedup(writer, &job, hash, &ok);
+    if (!repeat) {
+      Pixels__Async_Source *source = PIXELS_MALLOC(sizeof(*source));
+      if (source != NULL) {
+        memset(source, 0, sizeof(*source));
+        source->path = job.path;
+        // One for the job, one for being the last source
+        source->refs = 2;
+        job.source = source;
+        pixels__async_source_release(writer->last_source);
+        writer->last_source = source;
+        writer->last_hash = hash;
+      }
+    }
+    pixels__async_unlock(writer);
+    if (repeat) return ok;
+  }
+
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+  if (writer->thread_count > 0 && job.path != NULL) {
+    while (writer->queue_count == writer->opt.queue_size) pthread_cond_wait(&writer->job_taken, &writer->lock);
+    writer->queue[(writer->queue_head + writer->queue_count) % writer->opt.queue_size] = job;
+    writer->queue_count += 1;
+    pthread_cond_signal(&writer->job_ready);
+    pthread_mutex_unlock(&writer->lock);
+    return true;
+  }
+  pthread_mutex_unlock(&writer->lock);
+#endif // PIXELS_PTHREADS
+
+  // No encoder threads, the frame gets written right here
+  bool ok = job.path != NULL && pixels__write_image(job.path, &job.cnv, writer->opt.format, writer->opt.fast);
+  pixels__async_job_done(writer, &job, ok);
+  return ok;
+}
+
+bool pixels_async_writer_wait(Pixels_Async_Writer *writer) {
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+  while (writer->queue_count > 0 || writer->busy > 0) pthread_cond_wait(&writer->idle, &writer->lock);
+  bool ok = !writer->failed;
+  pthread_mutex_unlock(&writer->lock);
+  return ok;
+#else
+  return !writer->failed;
+#endif // PIXELS_PTHREADS
+}
+
+bool pixels_async_writer_destroy(Pixels_Async_Writer *writer) {
+#ifdef PIXELS_PTHREADS
+  pthread_mutex_lock(&writer->lock);
+  writer->stopping = true;
+  pthread_cond_broadcast(&writer->job_ready);
+  pthread_mutex_unlock(&writer->lock);
+  // Workers drain the queue before they notice stopping
+  for (int t = 0; t < writer->thread_count; ++t) pthread_join(writer->threads[t], NULL);
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->job_ready);
+  pthread_cond_destroy(&writer->job_taken);
+  pthread_cond_destroy(&writer->canvas_free);
+  pthread_cond_destroy(&writer->idle);
+#endif // PIXELS_PTHREADS
+  bool ok = !writer->failed;
+  pixels__async_source_release(writer->last_source);
+  for (int i = 0; i < writer->pool_count; ++i) pixels_destroy_canvas(&writer->pool[i]);
+  PIXELS_FREE(writer->pool);
+  PIXELS_FREE(writer->queue);
+  PIXELS_FREE(writer);
+  return ok;
+}
+
+typedef struct {
+  const char *path;
+  const unsigned char *data;
+  size_t size;
+} Pixels__Batch_File;
+
+struct Pixels_File_Batch {
+  Pixels_File_Batch_Opt opt;
+  unsigned char *buffer;
+  size_t used;
+  Pixels__Batch_File *pending;
+  int pending_count;
+  bool failed;
+#ifdef PIXELS_IO_URING
+  // -1 when writing synchronously
+  int ring_fd;
+  bool buffer_registered;
+  void *sq_map, *cq_map;
+  size_t sq_map_size, cq_map_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  _Atomic uint32_t *sq_tail, *cq_head, *cq_tail;
+  uint32_t *sq_array;
+  uint32_t sq_mask, cq_mask;
+  struct io_uring_cqe *cqes;
+#endif // PIXELS_IO_URING
+};
+
+#ifdef PIXELS_IO_URING
+static struct io_uring_sqe *pixels__uring_sqe(Pixels_File_Batch *batch, uint32_t index, uint8_t opcode, uint64_t user_data) {
+  uint32_t slot = index & batch->sq_mask;
+  struct io_uring_sqe *sqe = &batch->sqes[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->user_data = user_data;
+  batch->sq_array[slot] = slot;
+  return sqe;
+}
+
+// Opening straight into a direct descriptor slot needs Linux 5.15, older kernels set the ring up just fine and then
+// fail every open in it. A throwaway open of /dev/null into the first slot tells the two apart.
+static bool pixels__uring_probe(Pixels_File_Batch *batch) {
+  uint32_t tail = atomic_load_explicit(batch->sq_tail, memory_order_relaxed);
+  struct io_uring_sqe *sqe = pixels__uring_sqe(batch, tail++, IORING_OP_OPENAT, 0);
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uintptr_t)"/dev/null";
+  sqe->open_flags = O_RDONLY;
+  sqe->file_index = 1;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe = pixels__uring_sqe(batch, tail++, IORING_OP_CLOSE, 1);
+  sqe->file_index = 1;
+  atomic_store_explicit(batch->sq_tail, tail, memory_order_release);
+
+  unsigned to_submit = 2, remaining = 2;
+  bool ok = true;
+  while (remaining > 0) {
+    int submitted = (int)syscall(SYS_io_uring_enter, batch->ring_fd, to_submit, remaining, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (submitted < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    to_submit -= PIXELS_MIN((unsigned)submitted, to_submit);
+
+    uint32_t head = atomic_load_explicit(batch->cq_head, memory_order_relaxed);
+    uint32_t cq_tail = atomic_load_explicit(batch->cq_tail, memory_order_acquire);
+    for (; head != cq_tail; ++head, --remaining) ok = ok && batch->cqes[head & batch->cq_mask].res >= 0;
+    atomic_store_explicit(batch->cq_head, head, memory_order_release);
+  }
+  return ok;
+}
+
+// No liburing, the three syscalls are all it takes
+static bool pixels__uring_setup(Pixels_File_Batch *batch) {
+  unsigned entries = 3*batch->opt.files;
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int)syscall(SYS_io_uring_setup, entries, &params);
+  if (fd < 0) return false;
+  batch->ring_fd = fd;
+  // Older kernels map the two rings separately
+  batch->sq_map_size = params.sq_off.array + params.sq_entries*sizeof(uint32_t);
+  batch->cq_map_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) batch->sq_map_size = batch->cq_map_size = PIXELS_MAX(batch->sq_map_size, batch->cq_map_size);
+  batch->sq_map = mmap(NULL, batch->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (batch->sq_map == MAP_FAILED) return false;
+  batch->cq_map = single_mmap ? batch->sq_map : mmap(NULL, batch->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  if (batch->cq_map == MAP_FAILED) return false;
+  batch->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+  batch->sqes = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (batch->sqes == MAP_FAILED) return false;
+
+  unsigned char *sq = batch->sq_map, *cq = batch->cq_map;
+  batch->sq_tail = (_Atomic uint32_t*)(sq + params.sq_off.tail);
+  batch->sq_mask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+  batch->sq_array = (uint32_t*)(sq + params.sq_off.array);
+  batch->cq_head = (_Atomic uint32_t*)(cq + params.cq_off.head);
+  batch->cq_tail = (_Atomic uint32_t*)(cq + params.cq_off.tail);
+  batch->cq_mask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+  batch->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  // One empty direct descriptor slot per file in the batch
+  size_t checkpoint = pixels_temp_save();
+  int *slots = pixels_temp_alloc(sizeof(int)*batch->opt.files);
+  bool ok = slots != NULL;
+  if (ok) {
+    for (int i = 0; i < batch->opt.files; ++i) slots[i] = -1;
+    ok = syscall(SYS_io_uring_register, fd, IORING_REGISTER_FILES, slots, batch->opt.files) == 0;
+  }
+  pixels_temp_rewind(checkpoint);
+  if (!ok) return false;
+
+  // Pinning the buffer can hit RLIMIT_MEMLOCK, plain writes from it work just as well then
+  struct iovec iov = { batch->buffer, batch->opt.buffer_size };
+  batch->buffer_registered = syscall(SYS_io_uring_register, fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+  return pixels__uring_probe(batch);
+}
+
+static void pixels__uring_teardown(Pixels_File_Batch *batch) {
+  if (batch->sqes != NULL && batch->sqes != MAP_FAILED) munmap(batch->sqes, batch->sqes_size);
+  if (batch->cq_map != NULL && batch->cq_map != MAP_FAILED && batch->cq_map != batch->sq_map) munmap(batch->cq_map, batch->cq_map_size);
+  if (batch->sq_map != NULL && batch->sq_map != MAP_FAILED) munmap(batch->sq_map, batch->sq_map_size);
+  if (batch->ring_fd >= 0) close(batch->ring_fd);
+  batch->sqes = NULL;
+  batch->sq_map = batch->cq_map = NULL;
+  batch->ring_fd = -1;
+}
+
+static bool pixels__uring_flush(Pixels_File_Batch *batch) {
+  uint32_t tail = atomic_load_explicit(batch->sq_tail, memory_order_relaxed);
+  for (int i = 0; i < batch->pending_count; ++i) {
+    Pixels__Batch_File *file = &batch->pending[i];
+    // The write only runs if the open worked, the close runs even if the write came up short
+    struct io_uring_sqe *sqe = pixels__uring_sqe(batch, tail++, IORING_OP_OPENAT, 3*i);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)file->path;
+    // Direct descriptors never reach the fd table, the kernel rejects O_CLOEXEC for them
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->len = 0644;
+    sqe->file_index = i + 1;
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = pixels__uring_sqe(batch, tail++, batch->buffer_registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, 3*i + 1);
+    sqe->fd = i;
+    sqe->addr = (uintptr_t)file->data;
+    sqe->len = (uint32_t)file->size;
+    sqe->off = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+    sqe = pixels__uring_sqe(batch, tail++, IORING_OP_CLOSE, 3*i + 2);
+    sqe->file_index = i + 1;
+  }
+  atomic_store_explicit(batch->sq_tail, tail, memory_order_release);
+
+  unsigned to_submit = 3*batch->pending_count;
+  unsigned remaining = to_submit;
+  bool ok = true;
+  while (remaining > 0) {
+    int submitted = (int)syscall(SYS_io_uring_enter, batch->ring_fd, to_submit, remaining, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (submitted < 0) {
+      if (errno == EINTR) continue;
+      // Nothing else is coming back, the ring is in a state we can't trust anymore
+      pixels__uring_teardown(batch);
+      return false;
+    }
+    to_submit -= PIXELS_MIN((unsigned)submitted, to_submit);
+
+    uint32_t head = atomic_load_explicit(batch->cq_head, memory_order_relaxed);
+    uint32_t cq_tail = atomic_load_explicit(batch->cq_tail, memory_order_acquire);
+    for (; head != cq_tail; ++head, --remaining) {
+      struct io_uring_cqe *cqe = &batch->cqes[head & batch->cq_mask];
+      const Pixels__Batch_File *file = &batch->pending[cqe->user_data/3];
+      switch (cqe->user_data % 3) {
+        case 0: ok = ok && cqe->res >= 0; break;
+        case 1: ok = ok && cqe->res == (int32_t)file->size; break;
+        case 2: ok = ok && cqe->res == 0; break;
+      }
+    }
+    atomic_store_explicit(batch->cq_head, head, memory_order_release);
+  }
+  return ok;
+}
+#endif // PIXELS_IO_URING
+
+Pixels_File_Batch *pixels_file_batch_create_opt(Pixels_File_Batch_Opt opt) {
+  if (opt.files <= 0) opt.files = PIXELS_FILE_BATCH_FILES;
+  if (opt.buffer_size == 0) opt.buffer_size = PIXELS_FILE_BATCH_BYTES;
+  Pixels_File_Batch *batch = PIXELS_MALLOC(sizeof(*batch));
+  if (batch == NULL) return NULL;
+  memset(batch, 0, sizeof(*batch));
+  batch->opt = opt;
+  batch->buffer = PIXELS_MALLOC(opt.buffer_size);
+  batch->pending = PIXELS_MALLOC(sizeof(Pixels__Batch_File)*opt.files);
+  if (batch->buffer == NULL || batch->pending == NULL) {
+    PIXELS_FREE(batch->buffer);
+    PIXELS_FREE(batch->pending);
+    PIXELS_FREE(batch);
+    return NULL;
+  }
+#ifdef PIXELS_IO_URING
+  batch->ring_fd = -1;
+  if (!opt.sync && !pixels__uring_setup(batch)) pixels__uring_teardown(batch);
+#endif // PIXELS_IO_URING
+  return batch;
+}
+
+bool pixels_file_batch_uses_io_uring(const Pixels_File_Batch *batch) {
+#ifdef PIXELS_IO_URING
+  return batch->ring_fd >= 0;
+#else
+  (void)batch;
+  return false;
+#endif // PIXELS_IO_URING
+}
+
+bool pixels_file_batch_flush(Pixels_File_Batch *batch) {
+  bool ok = true;
+#ifdef PIXELS_IO_URING
+  if (batch->ring_fd >= 0 && batch->pending_count > 0) {
+    ok = pixels__uring_flush(batch);
+    // A ring that broke down got torn down, the files are still pending and go out through the loop below
+    if (batch->ring_fd >= 0) batch->pending_count = 0;
+    else ok = true;
+  }
+#endif // PIXELS_IO_URING
+#ifdef PIXELS_POSIX
+  for (int i = 0; i < batch->pending_count; ++i) {
+    const Pixels__Batch_File *file = &batch->pending[i];
+    int fd = open(file->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = ok && fd >= 0 && pixels__write_fd((void*)(intptr_t)fd, file->data, file->size);
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+  }
+#else
+  ok = ok && batch->pending_count == 0;
+#endif // PIXELS_POSIX
+  batch->pending_count = 0;
+  batch->used = 0;
+  batch->failed = batch->failed || !ok;
+  return !batch->failed;
+}
+
+// Room for the path and at least size more bytes, flushing the batch if it's full. NULL if it can never fit.
+static unsigned char *pixels__batch_stage_path(Pixels_File_Batch *batch, const char *path, size_t size) {
+  size_t path_size = strlen(path) + 1;
+  if (path_size + size > batch->opt.buffer_size) return NULL;
+  if (batch->pending_count == batch->opt.files || batch->used + path_size + size > batch->opt.buffer_size) {
+    pixels_file_batch_flush(batch);
+  }
+  memcpy(batch->buffer + batch->used, path, path_size);
+  Pixels__Batch_File *file = &batch->pending[batch->pending_count];
+  file->path = (const char*)batch->buffer + batch->used;
+  file->data = batch->buffer + batch->used + path_size;
+  file->size = 0;
+  return batch->buffer + batch->used + path_size;
+}
+
+static void pixels__batch_commit(Pixels_File_Batch *batch, size_t size) {
+  Pixels__Batch_File *file = &batch->pending[batch->pending_count++];
+  file->size = size;
+  batch->used = (size_t)(file->data - batch->buffer) + size;
+}
+
+bool pixels_file_batch_write(Pixels_File_Batch *batch, const char *path, const void *data, size_t size) {
+  unsigned char *dst = pixels__batch_stage_path(batch, path, size);
+  if (dst == NULL) {
+    // Bigger than the whole staging buffer, straight to the file
+#ifdef PIXELS_POSIX
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 && pixels__write_fd((void*)(intptr_t)fd, data, size);
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+#else
+    bool ok = false;
+#endif // PIXELS_POSIX
+    batch->failed = batch->failed || !ok;
+    return ok;
+  }
+  memcpy(dst, data, size);
+  pixels__batch_commit(batch, size);
+  return true;
+}
+
+bool pixels_file_batch_write_image(Pixels_File_Batch *batch, const char *path, const Pixels_Canvas *cnv, Pixels_Image_Format format) {
+  // Encode into whatever is left, if that runs out try again with an empty buffer
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (attempt > 0) {
+      if (batch->pending_count == 0) break;
+      pixels_file_batch_flush(batch);
+    }
+    unsigned char *dst = pixels__batch_stage_path(batch, path, 0);
+    if (dst == NULL) break;
+    size_t capacity = batch->opt.buffer_size - (size_t)(dst - batch->buffer), size;
+    bool ok = format == PIXELS_IMAGE_QOI
+      ? pixels_encode_qoi_to_buffer(cnv, dst, capacity, &size)
+      : pixels_encode_png_to_buffer(cnv, dst, capacity, &size);
+    if (ok) {
+      pixels__batch_commit(batch, size);
+      return true;
+    }
+  }
+  bool ok = pixels__write_image(path, cnv, format, false);
+  batch->failed = batch->failed || !ok;
+  return ok;
+}
+
+bool pixels_file_batch_destroy(Pixels_File_Batch *batch) {
+  bool ok = pixels_file_batch_flush(batch);
+#ifdef PIXELS_IO_URING
+  pixels__uring_teardown(batch);
+#endif // PIXELS_IO_URING
+  PIXELS_FREE(batch->pending);
+  PIXELS_FREE(batch->buffer);
+  PIXELS_FREE(batch);
+  return ok;
+}
+#endif // PIXELS_IMPLEMENTATION
+
+#ifndef PIXELS_STRIP_GUARD_H_
+  #ifdef PIXELS_STRIP_PREFIX
+    // temp_* helpers are left prefixed so this can be stripped next to nob.h
+    #define Arena Pixels_Arena
+    #define create_arena pixels_create_arena
+    #define arena_from_buffer pixels_arena_from_buffer
+    #define destroy_arena pixels_destroy_arena
+    #define arena_alloc pixels_arena_alloc
+    #define arena_reset pixels_arena_reset
+    #define arena_save pixels_arena_save
+    #define arena_rewind pixels_arena_rewind
+
+    #define Rgba Pixels_Rgba
+    #define RGBa Pixels_RGBa
+    #define RGB Pixels_RGB
+    #define RGB_Fmt Pixels_RGB_Fmt
+    #define RGB_Arg Pixels_RGB_Arg
+    #define RGBa_Fmt Pixels_RGBa_Fmt
+    #define RGBa_Arg Pixels_RGBa_Arg
+    #define RED Pixels_RED
+    #define GREEN Pixels_GREEN
+    #define BLUE Pixels_BLUE
+
+    #define Hsla Pixels_Hsla
+    #define HSLa Pixels_HSLa
+    #define HSL Pixels_HSL
+    #define HSL_Fmt Pixels_HSL_Fmt
+    #define HSL_Arg Pixels_HSL_Arg
+    #define HSLa_Fmt Pixels_HSLa_Fmt
+    #define HSLa_Arg Pixels_HSLa_Arg
+    #define rgb2hsl pixels_rgb2hsl
+    #define hsl2rgb pixels_hsl2rgb
+    #define Hsla_Planes Pixels_Hsla_Planes
+    #define rgb2hsl_span pixels_rgb2hsl_span
+    #define hsl2rgb_span pixels_hsl2rgb_span
+    #define canvas_rgb2hsl pixels_canvas_rgb2hsl
+    #define canvas_hsl2rgb pixels_canvas_hsl2rgb
+    #define Hsl_Lut Pixels_Hsl_Lut
+    #define build_hsl_lut pixels_build_hsl_lut
+    #define canvas_apply_hsl_lut pixels_canvas_apply_hsl_lut
+    #define canvas_adjust_hsl pixels_canvas_adjust_hsl
+    #define release_hsl_lut_cache pixels_release_hsl_lut_cache
 
     #define Vector2f Pixels_Vector2f
     #define Vec2f Pixels_Vec2f
@@ -516,6 +5738,33 @@ Pixels_Rgba pixels_hsl2rgb(Pixels_Hsla hsl) {
 
     #define Canvas Pixels_Canvas
     #define create_canvas pixels_create_canvas
+    #define create_canvas_tiled pixels_create_canvas_tiled
+    #define Canvas_Opt Pixels_Canvas_Opt
+    #define create_canvas_opt pixels_create_canvas_opt
+    #define create_canvas_ex pixels_create_canvas_ex
+    #define destroy_canvas pixels_destroy_canvas
+    #define canvas_fill pixels_canvas_fill
+    #define Mapped_Header Pixels_Mapped_Header
+    #define create_canvas_mapped pixels_create_canvas_mapped
+    #define open_canvas_mapped pixels_open_canvas_mapped
+    #define canvas_flush pixels_canvas_flush
+    #define Frame_Ring Pixels_Frame_Ring
+    #define frame_ring_create pixels_frame_ring_create
+    #define frame_ring_open pixels_frame_ring_open
+    #define frame_ring_open_fd pixels_frame_ring_open_fd
+    #define frame_ring_close pixels_frame_ring_close
+    #define frame_ring_acquire pixels_frame_ring_acquire
+    #define frame_ring_publish pixels_frame_ring_publish
+    #define frame_ring_next pixels_frame_ring_next
+    #define frame_ring_release pixels_frame_ring_release
+    #define Traversal Pixels_Traversal
+    #define tile_order pixels_tile_order
+    #define canvas_linearize pixels_canvas_linearize
+    #define premultiply_span pixels_premultiply_span
+    #define unpremultiply_span pixels_unpremultiply_span
+    #define canvas_premultiply pixels_canvas_premultiply
+    #define canvas_unpremultiply pixels_canvas_unpremultiply
+    #define canvas_export_straight pixels_canvas_export_straight
 
     #define get_pixel pixels_get_pixel
     #define set_pixel pixels_set_pixel
@@ -529,7 +5778,104 @@ Pixels_Rgba pixels_hsl2rgb(Pixels_Hsla hsl) {
     #define square_eucledian_dist_vec2f pixels_square_eucledian_dist_vec2f
     #define full_eucledian_dist_vec2f pixels_full_eucledian_dist_vec2f
 
+    #define Blend_Mode Pixels_Blend_Mode
+    #define blend_span pixels_blend_span
+    #define Render_Opt Pixels_Render_Opt
+    #define srgb_to_linear pixels_srgb_to_linear
+    #define linear_to_srgb pixels_linear_to_srgb
     #define render_triangle pixels_render_triangle
+    #define render_triangle_opt pixels_render_triangle_opt
+    #define render_triangle_ex pixels_render_triangle_ex
+    #define Scene_Fn Pixels_Scene_Fn
+    #define Band_Sink_Fn Pixels_Band_Sink_Fn
+    #define Banded_Opt Pixels_Banded_Opt
+    #define render_banded_opt pixels_render_banded_opt
+    #define render_banded pixels_render_banded
+
+    #define Rgbaf Pixels_Rgbaf
+    #define Rgbah Pixels_Rgbah
+    #define float_to_half pixels_float_to_half
+    #define half_to_float pixels_half_to_float
+    #define CanvasF Pixels_CanvasF
+    #define create_canvasf pixels_create_canvasf
+    #define create_canvasf_half pixels_create_canvasf_half
+    #define destroy_canvasf pixels_destroy_canvasf
+    #define render_trianglef pixels_render_trianglef
+    #define render_trianglef_opt pixels_render_trianglef_opt
+    #define render_trianglef_ex pixels_render_trianglef_ex
+    #define Tonemap_Operator Pixels_Tonemap_Operator
+    #define Tonemap_Opt Pixels_Tonemap_Opt
+    #define canvasf_tonemap_opt pixels_canvasf_tonemap_opt
+    #define canvasf_tonemap pixels_canvasf_tonemap
+
+    #define Bgra8 Pixels_Bgra8
+    #define Canvas_Bgra8 Pixels_Canvas_Bgra8
+    #define Canvas_Rgb565 Pixels_Canvas_Rgb565
+    #define Canvas_Gray8 Pixels_Canvas_Gray8
+    #define Canvas_Rgba16f Pixels_Canvas_Rgba16f
+    #define Canvas_Indexed Pixels_Canvas_Indexed
+    #define create_canvas_indexed pixels_create_canvas_indexed
+    #define destroy_canvas_indexed pixels_destroy_canvas_indexed
+    #define palette_index pixels_palette_index
+    #define render_triangle_index pixels_render_triangle_index
+    #define render_triangle_indexed pixels_render_triangle_indexed
+    #define canvas_indexed_to_rgba pixels_canvas_indexed_to_rgba
+
+    #define Mask Pixels_Mask
+    #define Mask_Op Pixels_Mask_Op
+    #define create_mask pixels_create_mask
+    #define destroy_mask pixels_destroy_mask
+    #define mask_clear pixels_mask_clear
+    #define mask_get pixels_mask_get
+    #define render_triangle_mask pixels_render_triangle_mask
+    #define Write_Fn Pixels_Write_Fn
+    #define Png_Writer Pixels_Png_Writer
+    #define png_init pixels_png_init
+    #define png_init_to_func pixels_png_init_to_func
+    #define png_write_rows pixels_png_write_rows
+    #define png_write_canvas pixels_png_write_canvas
+    #define png_finish pixels_png_finish
+    #define write_png pixels_write_png
+    #define Png_Opt Pixels_Png_Opt
+    #define png_band_rows pixels_png_band_rows
+    #define encode_png_opt pixels_encode_png_opt
+    #define encode_png pixels_encode_png
+    #define encode_qoi pixels_encode_qoi
+    #define write_qoi pixels_write_qoi
+    #define decode_qoi pixels_decode_qoi
+    #define read_qoi pixels_read_qoi
+    #define canvas_hash pixels_canvas_hash
+    #define png_max_size pixels_png_max_size
+    #define encode_png_to_buffer pixels_encode_png_to_buffer
+    #define qoi_max_size pixels_qoi_max_size
+    #define encode_qoi_to_buffer pixels_encode_qoi_to_buffer
+    #define Video_Format Pixels_Video_Format
+    #define Video_Opt Pixels_Video_Opt
+    #define Video_Sink Pixels_Video_Sink
+    #define video_sink_open_opt pixels_video_sink_open_opt
+    #define video_sink_open pixels_video_sink_open
+    #define video_sink_write pixels_video_sink_write
+    #define video_sink_close pixels_video_sink_close
+    #define rgba_to_yuv420_rows pixels_rgba_to_yuv420_rows
+    #define Image_Format Pixels_Image_Format
+    #define Dedup_Mode Pixels_Dedup_Mode
+    #define Async_Writer_Opt Pixels_Async_Writer_Opt
+    #define Async_Writer Pixels_Async_Writer
+    #define async_writer_create_opt pixels_async_writer_create_opt
+    #define async_writer_create pixels_async_writer_create
+    #define async_writer_acquire pixels_async_writer_acquire
+    #define async_writer_submit pixels_async_writer_submit
+    #define async_writer_wait pixels_async_writer_wait
+    #define async_writer_destroy pixels_async_writer_destroy
+    #define File_Batch_Opt Pixels_File_Batch_Opt
+    #define File_Batch Pixels_File_Batch
+    #define file_batch_create_opt pixels_file_batch_create_opt
+    #define file_batch_create pixels_file_batch_create
+    #define file_batch_uses_io_uring pixels_file_batch_uses_io_uring
+    #define file_batch_write pixels_file_batch_write
+    #define file_batch_write_image pixels_file_batch_write_image
+    #define file_batch_flush pixels_file_batch_flush
+    #define file_batch_destroy pixels_file_batch_destroy
   #endif // PIXELS_STRIP_PREFIX
 #endif // PIXELS_STRIP_GUARD_H_
 